@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Gera uma atualizacao incremental do catalogo (ver src/catalog_delta.h).
+
+Le dois catalogos no formato de texto do carregador (CAT <n>, "<hora> <preco> <titulo>",
+END), escreve as diferencas em binario e compara o tamanho com o envio do catalogo
+completo:
+
+    catalog_delta.py antigo.txt novo.txt --base-version 1 -o delta.bin
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0xCD
+SKIP, PRICE, HOUR, FULL = range(4)
+MAX_RUN = 64
+
+
+def crc16_ccitt(seed, data):
+    """Mesmo algoritmo que crc16_ccitt() do Zephyr."""
+    for b in data:
+        e = (seed ^ b) & 0xFF
+        f = (e ^ (e << 4)) & 0xFF
+        seed = ((seed >> 8) ^ (f << 8) ^ (f << 3) ^ (f >> 4)) & 0xFFFF
+    return seed
+
+
+def load(path):
+    sessions = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0] in ("CAT", "END"):
+                continue
+            sessions.append((" ".join(fields[2:]), int(fields[0]), int(fields[1])))
+    return sessions
+
+
+def catalog_crc(sessions):
+    crc = 0xFFFF
+    for title, hour, price in sessions:
+        crc = crc16_ccitt(crc, title.encode("ascii") + b"\0" + bytes([hour, price]))
+    return crc
+
+
+def kind(old, new, i):
+    if i >= len(old):
+        return FULL
+    o, n = old[i], new[i]
+    if o == n:
+        return SKIP
+    if o[0] == n[0] and o[1] == n[1]:
+        return PRICE
+    if o[0] == n[0] and o[2] == n[2]:
+        return HOUR
+    return FULL
+
+
+def encode_ops(old, new):
+    ops = bytearray()
+    i = 0
+    while i < len(new):
+        k = kind(old, new, i)
+        n = 1
+        while i + n < len(new) and n < MAX_RUN and kind(old, new, i + n) == k:
+            n += 1
+        ops.append((k << 6) | (n - 1))
+        for title, hour, price in new[i:i + n]:
+            if k == PRICE:
+                ops.append(price)
+            elif k == HOUR:
+                ops.append(hour)
+            elif k == FULL:
+                name = title.encode("ascii")
+                ops += bytes([hour, price, len(name)]) + name
+        i += n
+    return bytes(ops)
+
+
+def text_size(sessions):
+    lines = ["CAT %d" % len(sessions)]
+    lines += ["%d %d %s" % (h, p, t) for t, h, p in sessions]
+    lines.append("END")
+    return sum(len(l) + 1 for l in lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--base-version", type=int, required=True,
+                        help="versao em uso na maquina (impressa em 'Catalogo atualizado')")
+    parser.add_argument("--version", type=int, help="versao nova (por omissao base + 1)")
+    parser.add_argument("-o", "--output", help="ficheiro binario a escrever")
+    args = parser.parse_args()
+
+    old, new = load(args.old), load(args.new)
+    version = args.version if args.version is not None else args.base_version + 1
+    ops = encode_ops(old, new)
+    if len(ops) > 0xFFFF:
+        sys.exit("atualizacao demasiado grande")
+    delta = bytes([MAGIC]) + struct.pack("<IIHHH", args.base_version, version, len(new),
+                                         catalog_crc(new), len(ops)) + ops
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(delta)
+
+    full_bin = 15 + len(encode_ops([], new))
+    print("sessoes %d -> %d, versao %d -> %d, crc 0x%04x" %
+          (len(old), len(new), args.base_version, version, catalog_crc(new)))
+    print("completo (texto) %d bytes, completo (binario) %d bytes, incremental %d bytes" %
+          (text_size(new), full_bin, len(delta)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Gera as paginas comprimidas (LZ4) com os detalhes dos filmes (ver src/catalog_details.h).
+
+Le um CSV com as colunas name,rating,synopsis (name = titulo do filme no catalogo),
+agrupa os filmes, ordenados pelo titulo, em paginas de --page-films filmes, comprime cada
+pagina como um bloco LZ4 independente e escreve um ficheiro .inc com os dados. Os
+titulos ficam numa tabela ordenada nao comprimida, para a pesquisa:
+
+    catalog_pack.py catalog/films.csv catalog_pages.inc --page-films 4
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+MIN_MATCH = 4
+# Formato de bloco LZ4: os ultimos 5 bytes sao literais e o ultimo match
+# tem de começar pelo menos 12 bytes antes do fim
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_OFFSET = 0xFFFF
+
+
+def lz4_len(n):
+    out = bytearray()
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+    return out
+
+
+def lz4_sequence(out, literals, match_len, offset):
+    lit = len(literals)
+    token = (min(lit, 15) << 4)
+    if match_len:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        out += lz4_len(lit - 15)
+    out += literals
+    if match_len:
+        out += struct.pack("<H", offset)
+        if match_len - MIN_MATCH >= 15:
+            out += lz4_len(match_len - MIN_MATCH - 15)
+
+
+def lz4_compress(data):
+    """Compressor LZ4 (bloco) simples: procura gulosa com tabela de hash de 4 bytes."""
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    n = len(data)
+    while i + MF_LIMIT <= n:
+        key = data[i:i + MIN_MATCH]
+        cand = table.get(key)
+        table[key] = i
+        if cand is None or i - cand > MAX_OFFSET:
+            i += 1
+            continue
+        length = MIN_MATCH
+        while i + length < n - LAST_LITERALS and data[cand + length] == data[i + length]:
+            length += 1
+        lz4_sequence(out, data[anchor:i], length, i - cand)
+        i += length
+        anchor = i
+    lz4_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress(src, size):
+    """Descompressor de referencia, para verificar os blocos gerados."""
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = src[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+        out += src[i:i + lit]
+        i += lit
+        if i >= len(src):
+            break
+        offset = src[i] | src[i + 1] << 8
+        i += 2
+        length = (token & 15) + MIN_MATCH
+        if token & 15 == 15:
+            while True:
+                b = src[i]
+                i += 1
+                length += b
+                if b != 255:
+                    break
+        for _ in range(length):
+            out.append(out[-offset])
+    if len(out) != size:
+        raise ValueError("tamanho descomprimido errado")
+    return bytes(out)
+
+
+def page_raw(films):
+    """u16 numero de filmes, u16 inicio de cada filme, depois classificacao\\0sinopse\\0."""
+    header = 2 + 2 * len(films)
+    body = bytearray()
+    offsets = []
+    for f in films:
+        offsets.append(header + len(body))
+        for field in ("rating", "synopsis"):
+            body += f[field].encode("ascii") + b"\0"
+    return struct.pack("<H%dH" % len(films), len(films), *offsets) + bytes(body)
+
+
+def c_bytes(data, indent="\t"):
+    lines = []
+    for k in range(0, len(data), 12):
+        lines.append(indent + " ".join("0x%02x," % b for b in data[k:k + 12]))
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("csv")
+    parser.add_argument("output")
+    parser.add_argument("--page-films", type=int, default=4)
+    args = parser.parse_args()
+
+    with open(args.csv, newline="") as f:
+        films = sorted(csv.DictReader(f), key=lambda r: r["name"].encode("ascii"))
+    titles = [r["name"] for r in films]
+    if len(set(titles)) != len(titles):
+        sys.exit("titulos repetidos")
+
+    pages = []
+    for p in range(0, len(films), args.page_films):
+        raw = page_raw(films[p:p + args.page_films])
+        comp = lz4_compress(raw)
+        if lz4_decompress(comp, len(raw)) != raw:
+            sys.exit("erro na compressao da pagina %d" % len(pages))
+        pages.append((raw, comp))
+
+    raw_total = sum(len(r) for r, _ in pages)
+    comp_total = sum(len(c) for _, c in pages)
+    with open(args.output, "w") as out:
+        out.write("/* Gerado por scripts/catalog_pack.py a partir de %s, nao editar */\n\n"
+                  % args.csv.replace("\\", "/").split("/")[-1])
+        out.write("#define CATALOG_PAGE_FILMS %d\n" % args.page_films)
+        out.write("#define CATALOG_FILMS %d\n" % len(films))
+        out.write("#define CATALOG_PAGES %d\n" % len(pages))
+        out.write("#define CATALOG_PAGE_MAX %d\n" % max(len(r) for r, _ in pages))
+        out.write("#define CATALOG_RAW_BYTES %d\n" % raw_total)
+        out.write("#define CATALOG_PACKED_BYTES %d\n\n" % comp_total)
+        out.write("static const char *const film_title[CATALOG_FILMS] = {\n%s\n};\n\n"
+                  % "\n".join('\t"%s",' % t.replace('"', '\\"') for t in titles))
+        out.write("static const uint8_t page_data[] = {\n%s\n};\n\n"
+                  % c_bytes(b"".join(c for _, c in pages)))
+        out.write("static const struct catalog_page pages[CATALOG_PAGES] = {\n")
+        offset = 0
+        for raw, comp in pages:
+            out.write("\t{ .offset = %d, .size = %d, .raw = %d },\n"
+                      % (offset, len(comp), len(raw)))
+            offset += len(comp)
+        out.write("};\n")
+
+    print("catalog_pack: %d filmes, %d paginas, %d -> %d bytes (%.0f%%)"
+          % (len(films), len(pages), raw_total, comp_total, 100.0 * comp_total / raw_total))
+
+
+if __name__ == "__main__":
+    main()
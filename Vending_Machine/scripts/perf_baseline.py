@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Grava a baseline de desempenho a partir do registo da suite tests/vending.
+
+Le as linhas "PERF BEGIN <placa> <motor>" e "PERF <nome> <valor> ..." impressas pela
+suite (consola ou handler.log do twister) e escreve tests/vending/baselines/<placa>_<motor>.h,
+que a suite compara nas execucoes seguintes:
+
+    west build -b qemu_cortex_m3 tests/vending -- -DCONFIG_VENDING_PERF_RECORD=y
+    west build -t run | tee perf.log
+    perf_baseline.py perf.log
+
+Com --margin os valores gravados sao aumentados nessa percentagem (ruido da placa).
+"""
+
+import argparse
+import os
+import sys
+
+BASELINES = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests", "vending",
+                         "baselines")
+
+
+def extract(path):
+    """Devolve (placa, motor, {nome: valor}) do ultimo bloco PERF do registo."""
+    board, engine, values = None, None, {}
+    with open(path, errors="replace") as f:
+        for line in f:
+            pos = line.find("PERF ")
+            if pos < 0:
+                continue
+            fields = line[pos:].split()
+            if fields[1] == "BEGIN" and len(fields) >= 4:
+                board, engine, values = fields[2], fields[3], {}
+            elif board is not None and len(fields) >= 3:
+                values[fields[1]] = int(fields[2])
+    if board is None or not values:
+        sys.exit("nenhum bloco PERF em %s" % path)
+    return board, engine, values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="registo da consola da suite tests/vending")
+    parser.add_argument("--margin", type=int, default=0,
+                        help="percentagem a somar a cada valor (default 0)")
+    parser.add_argument("-o", "--output", help="ficheiro a escrever (default baselines/<placa>_<motor>.h)")
+    args = parser.parse_args()
+
+    board, engine, values = extract(args.log)
+    out = args.output or os.path.join(BASELINES, "%s_%s.h" % (board, engine))
+
+    os.makedirs(os.path.dirname(os.path.abspath(out)), exist_ok=True)
+    with open(out, "w") as f:
+        f.write("/* SPDX-License-Identifier: Apache-2.0 */\n")
+        f.write("/* Baseline de %s (%s), gerada por scripts/perf_baseline.py */\n\n" % (board, engine))
+        for name, value in values.items():
+            # valores a 0 (p.ex. tempos em native_posix) ficam sem baseline
+            f.write("#define PERF_BASE_%s %d\n" % (name.upper(), value * (100 + args.margin) // 100))
+    print("%s: %s" % (out, ", ".join("%s=%d" % kv for kv in values.items())))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Extrai a gravacao de eventos do registo da consola (ver src/recorder.h).
+
+Le as linhas "REC BEGIN", "REC <hex>" e "REC END" impressas pela linha DUMP, escreve o
+ficheiro para a reproducao em native_posix e, com --list, mostra os registos:
+
+    rec_extract.py consola.log -o falha.rec --list
+    ./build/zephyr/zephyr.exe -replay=falha.rec -replay-fast
+"""
+
+import argparse
+import struct
+import sys
+
+ENTRY = struct.Struct("<IIBBBB")
+HEADER = struct.Struct("<4sBBHI")
+MAGIC = b"VREC"
+VERSION = 2
+# dt em ms em vez de us (ver REC_DT_MS em recorder.h)
+DT_MS = 0x80000000
+
+KINDS = {1: "flanco", 2: "evento", 3: "hora"}
+EVENTS = ["NONE", "ADD1", "ADD2", "ADD5", "ADD10", "UP", "DOWN", "SEL", "RET"]
+STATES = ["MENU", "MOVIES", "UPDATE_CREDIT"]
+
+
+def extract(path):
+    """Devolve (paineis, registos) do ultimo bloco completo do registo."""
+    lanes, entries, block = 1, None, None
+    with open(path, errors="replace") as f:
+        for line in f:
+            # o prefixo pode trazer lixo da consola antes de "REC"
+            pos = line.find("REC ")
+            if pos < 0:
+                continue
+            fields = line[pos:].split()
+            if fields[1] == "BEGIN":
+                block = []
+                lanes = int(fields[3]) if len(fields) > 3 else 1
+            elif fields[1] == "END":
+                if block is not None:
+                    entries = block
+                block = None
+            elif block is not None:
+                raw = bytes.fromhex(fields[1])
+                if len(raw) != ENTRY.size:
+                    sys.exit("registo com %d bytes: %s" % (len(raw), fields[1]))
+                block.append(ENTRY.unpack(raw))
+    if entries is None:
+        sys.exit("nenhum bloco REC BEGIN/REC END completo em %s" % path)
+    return lanes, entries
+
+
+def dt_us(e):
+    """Intervalo do registo desde o anterior, em us."""
+    dt = e[0]
+    return (dt & ~DT_MS) * 1000 if dt & DT_MS else dt
+
+
+def times_us(entries):
+    """Instante de cada registo desde o primeiro (o intervalo do primeiro é ignorado)."""
+    t, out = 0, []
+    for k, e in enumerate(entries):
+        if k > 0:
+            t += dt_us(e)
+        out.append(t)
+    return out
+
+
+def describe(e, t_us):
+    _, arg, kind, lane, ev, state = e
+    t_ms = t_us / 1000.0
+    if kind == 1:
+        what = "porta %d pinos 0x%08x" % (lane, arg)
+    elif kind == 2:
+        what = "painel %d %-5s -> %s" % (lane, EVENTS[ev] if ev < len(EVENTS) else ev,
+                                          STATES[state] if state < len(STATES) else state)
+    else:
+        what = "%02d:%02d" % (arg // 60, arg % 60)
+    return "%10.3f ms  %-6s %s" % (t_ms, KINDS.get(kind, kind), what)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="registo da consola com a saida de DUMP")
+    parser.add_argument("-o", "--output", help="ficheiro de gravacao a escrever")
+    parser.add_argument("--list", action="store_true", help="imprimir os registos")
+    args = parser.parse_args()
+
+    lanes, entries = extract(args.log)
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(HEADER.pack(MAGIC, VERSION, ENTRY.size, lanes, len(entries)))
+            for e in entries:
+                f.write(ENTRY.pack(*e))
+
+    times = times_us(entries)
+    if args.list and entries:
+        for e, t in zip(entries, times):
+            print(describe(e, t))
+
+    counts = {}
+    for e in entries:
+        counts[e[2]] = counts.get(e[2], 0) + 1
+    span = times[-1] / 1e6 if entries else 0
+    print("%d registos (%s), %d paineis, %.3f s, %d bytes" %
+          (len(entries), ", ".join("%d %s" % (n, KINDS.get(k, k)) for k, n in sorted(counts.items())),
+           lanes, span, HEADER.size + len(entries) * ENTRY.size))
+
+
+if __name__ == "__main__":
+    main()
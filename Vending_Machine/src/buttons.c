@@ -0,0 +1,376 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file buttons.c
+* \brief Configuraçao dos botoes e callback que converte pinos em eventos
+*/
+
+#include <zephyr.h>
+#include <zephyr/device.h> /* device_is_ready and device struct */
+#include <zephyr/devicetree.h> /* DT_NODELABEL() */
+#include <zephyr/sys/printk.h> /* printk */
+#include <zephyr/drivers/gpio.h> /* GPIO api */
+#ifdef CONFIG_VENDING_ISR_TIMING
+#include <zephyr/timing/timing.h>
+#endif
+
+#include "buttons.h"
+#include "recorder.h"
+#include "trace.h"
+
+/** @brief Codigo de um botao na tabela de descodificaçao: painel nos bits altos, evento nos baixos */
+#define PIN_CODE(lane, ev) (((lane) << 4) | (ev))
+#define PIN_CODE_LANE(code) ((code) >> 4)
+#define PIN_CODE_EVENT(code) ((code) & 0x0F)
+
+#define BUTTON_PIN_CODE(lane, pin, ev, ms) [BUTTONS_LANE_PORT(lane)][pin] = PIN_CODE(lane, ev),
+#define BUTTON_PIN_STABLE(lane, pin, ev, ms) [BUTTONS_LANE_PORT(lane)][pin] = ms,
+
+/** @brief Tabela de descodificaçao (porta, pino) -> (painel, evento)
+ * indexada pelo numero do pino (0-31); pinos sem botao ficam a 0 (evento NONE) */
+static const uint8_t pin_code[BUTTONS_PORTS][32] = { BUTTONS_LIST(BUTTON_PIN_CODE) };
+
+BUILD_ASSERT(NONE == 0, "pin_code[] relies on NONE being 0");
+BUILD_ASSERT(NUM_EVENTS <= 16, "PIN_CODE() keeps the event in 4 bits");
+
+/** @brief Tempo de estabilizaçao (ms) de cada pino */
+static const uint8_t pin_stable_ms[BUTTONS_PORTS][32] = { BUTTONS_LIST(BUTTON_PIN_STABLE) };
+
+/** @brief Porta GPIO com botoes e respetivo estado do debounce
+ * Os pinos em espera tem a interrupçao desativada ate ao fim do tempo de estabilizaçao;
+ * um unico timer partilhado expira no prazo mais proximo e confirma todos os pinos
+ * cujo prazo terminou com uma unica leitura de cada porta. */
+struct button_port {
+	const struct device *dev;
+	/* Define a variable of type struct gpio_callback, which will latter be used to install the callback
+	*  It defines e.g. which pin triggers the callback and the address of the function */
+	struct gpio_callback cb;
+	uint32_t mask;			/**< pinos com botao (construida de pin_code) */
+	uint32_t pending;		/**< pinos a aguardar confirmaçao */
+	uint32_t deadline[32];		/**< instante (k_uptime_get_32) em que cada pino pode ser confirmado */
+#ifdef CONFIG_VENDING_TRACE
+	uint32_t edge[32];		/**< instante (relogio do trace) do primeiro flanco de cada pino */
+#endif
+};
+
+/* Get the device pointers for GPIO0 (leds and buttons of lane 0) and GPIO1 (other lanes) */
+static struct button_port ports[BUTTONS_PORTS] = {
+	{ .dev = DEVICE_DT_GET(DT_NODELABEL(gpio0)) },
+#if BUTTONS_PORTS > 1
+	{ .dev = DEVICE_DT_GET(DT_NODELABEL(gpio1)) },
+#endif
+};
+
+/** @brief Fila de cada painel onde sao colocados os eventos e semaforo para acordar a maquina de estados */
+static struct event_ring *buttons_ring[VM_LANES];
+static struct k_sem *buttons_wake;
+
+static struct buttons_isr_stats isr_stats;
+
+static struct k_spinlock debounce_lock;
+
+/** @brief Botoes armados por nivel (buttons_suspend()) e primeiro flanco nesse modo */
+static bool sense_mode;
+static bool sensed;
+static uint32_t sensed_edge;
+
+static void debounce_expired(struct k_timer *timer);
+K_TIMER_DEFINE(debounce_timer, debounce_expired, NULL);
+
+/** @brief (Re)arma o timer partilhado para o prazo mais proximo dos pinos em espera
+ * Chamada com debounce_lock adquirido. */
+static void debounce_arm(uint32_t now)
+{
+	int32_t wait = INT32_MAX;
+	int32_t left;
+	uint32_t pins, pin;
+	int p;
+
+	for (p = 0; p < BUTTONS_PORTS; p++) {
+		pins = ports[p].pending;
+		while (pins) {
+			pin = __builtin_ctz(pins);
+			left = (int32_t)(ports[p].deadline[pin] - now);
+			if (left < wait) {
+				wait = left;
+			}
+			pins &= pins - 1;
+		}
+	}
+	k_timer_start(&debounce_timer, K_MSEC(MAX(wait, 0)), K_NO_WAIT);
+}
+
+/** @brief Confirma os pinos de uma porta cujo prazo terminou
+ * Chamada com debounce_lock adquirido.
+ * @return true se foi colocado algum evento numa fila */
+static bool debounce_port(struct button_port *bp, const uint8_t *codes, uint32_t now)
+{
+	uint32_t pins = bp->pending;
+	uint32_t done = 0;
+	gpio_port_value_t level = 0;
+	uint32_t pin;
+	uint8_t code;
+
+	while (pins) {
+		pin = __builtin_ctz(pins);
+		if ((int32_t)(bp->deadline[pin] - now) <= 0) {
+			done |= BIT(pin);
+		}
+		pins &= pins - 1;
+	}
+	if (done == 0) {
+		return false;
+	}
+	bp->pending &= ~done;
+	gpio_port_get(bp->dev, &level);
+
+	pins = done;
+	while (pins) {
+		pin = __builtin_ctz(pins);
+		if (level & BIT(pin)) {
+			code = codes[pin];
+#ifdef CONFIG_VENDING_TRACE
+			event_ring_push_at(buttons_ring[PIN_CODE_LANE(code)], (Event)PIN_CODE_EVENT(code),
+					   bp->edge[pin]);
+#else
+			event_ring_push(buttons_ring[PIN_CODE_LANE(code)], (Event)PIN_CODE_EVENT(code));
+#endif
+			isr_stats.confirmed++;
+		} else {
+			isr_stats.rejected++;
+		}
+		gpio_pin_interrupt_configure(bp->dev, pin, GPIO_INT_EDGE_TO_ACTIVE);
+		pins &= pins - 1;
+	}
+	return (done & level) != 0;
+}
+
+/** @brief Fim do tempo de estabilizaçao (contexto de ISR do timer)
+ *
+ * Le cada porta com pinos expirados uma vez, gera os eventos dos pinos que continuam
+ * ativos na fila do respetivo painel e volta a ativar a interrupçao de todos os pinos
+ * cujo prazo terminou.
+*/
+static void debounce_expired(struct k_timer *timer)
+{
+	k_spinlock_key_t key = k_spin_lock(&debounce_lock);
+	uint32_t now = k_uptime_get_32();
+	bool pushed = false;
+	bool pending = false;
+	int p;
+
+	for (p = 0; p < BUTTONS_PORTS; p++) {
+		pushed |= debounce_port(&ports[p], pin_code[p], now);
+		pending |= ports[p].pending != 0;
+	}
+
+	if (pending) {
+		debounce_arm(now);
+	}
+	k_spin_unlock(&debounce_lock, key);
+
+	if (pushed) {
+		/* Acordar a maquina de estados */
+		k_sem_give(buttons_wake);
+	}
+}
+
+/* Define a callback function. It is like an ISR (and runs in the cotext of an ISR) */
+/* that is called when the button is pressed */
+
+/** @brief Funçao de callback com funcionamento identico a uma interrupçao
+ * 
+ * Primeiro flanco de cada pressao: desativa a interrupçao do pino (os ressaltos seguintes
+ * nao geram interrupçoes) e marca o pino para ser confirmado pelo timer de debounce apos
+ * o seu tempo de estabilizaçao (tabela pin_stable_ms, acesso direto por count trailing zeros).
+ * O evento (tabela pin_event) so é gerado em debounce_expired().
+*/
+void button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+#ifdef CONFIG_VENDING_ISR_TIMING
+	timing_t t0 = timing_counter_get();
+	timing_t t1;
+	uint32_t cycles;
+#endif
+	uint32_t t_edge __unused = trace_now();
+	struct button_port *bp = CONTAINER_OF(cb, struct button_port, cb);
+	const uint8_t *stable_ms = pin_stable_ms[bp - ports];
+	k_spinlock_key_t key = k_spin_lock(&debounce_lock);
+	uint32_t now = k_uptime_get_32();
+	uint32_t pin;
+
+	recorder_edge(bp - ports, pins);
+	if (sense_mode && !sensed) {
+		sensed = true;
+		sensed_edge = k_cycle_get_32();
+	}
+	pins &= bp->mask & ~bp->pending;
+	if (pins) {
+		bp->pending |= pins;
+		while (pins) {
+			pin = __builtin_ctz(pins);
+			gpio_pin_interrupt_configure(dev, pin, GPIO_INT_DISABLE);
+			bp->deadline[pin] = now + stable_ms[pin];
+#ifdef CONFIG_VENDING_TRACE
+			bp->edge[pin] = t_edge;
+#endif
+			pins &= pins - 1;
+		}
+		debounce_arm(now);
+	}
+	isr_stats.calls++;
+
+#ifdef CONFIG_VENDING_ISR_TIMING
+	t1 = timing_counter_get();
+	cycles = (uint32_t)timing_cycles_get(&t0, &t1);
+	isr_stats.total_cycles += cycles;
+	if (cycles > isr_stats.max_cycles) {
+		isr_stats.max_cycles = cycles;
+	}
+#endif
+	k_spin_unlock(&debounce_lock, key);
+}
+
+void buttons_isr_stats_get(struct buttons_isr_stats *st)
+{
+	k_spinlock_key_t key = k_spin_lock(&debounce_lock);
+
+	*st = isr_stats;
+	k_spin_unlock(&debounce_lock, key);
+}
+
+/** @brief Configura os pinos de uma porta e instala a sua callback */
+static int buttons_port_init(struct button_port *bp, const uint8_t *codes)
+{
+	uint32_t pins;
+	uint32_t pin;
+	int ret;
+
+	if (!device_is_ready(bp->dev)) {
+		printk("Error: %s not ready\n\r", bp->dev->name);
+		return -ENODEV;
+	}
+
+	for (pin = 0; pin < 32; pin++) {
+		if (PIN_CODE_EVENT(codes[pin]) != NONE) {
+			bp->mask |= BIT(pin);
+		}
+	}
+
+	/*Configure the GPIO pins - buttons 1-4 + IOPINS 2,4,28 and 29 for input (lane 0)*/
+	/** @brief Configuraçao dos pinos de entrada
+	 * 
+	 * Os pinos usados para utilizar os butoes têm de ser configurados como entradas
+	*/
+	pins = bp->mask;
+	while (pins) {
+		pin = __builtin_ctz(pins);
+		ret = gpio_pin_configure(bp->dev, pin, GPIO_INPUT | GPIO_PULL_UP);
+		if (ret < 0) {
+			printk("Error: gpio_pin_configure failed for lane %d/%s pin %d, error:%d\n\r",
+			       PIN_CODE_LANE(codes[pin]), bp->dev->name, pin, ret);
+			return ret;
+		} else {
+			printk("Success: gpio_pin_configure for lane %d/%s pin %d\n\r",
+			       PIN_CODE_LANE(codes[pin]), bp->dev->name, pin);
+		}
+		pins &= pins - 1;
+	}
+
+	/* Configure the interrupt on the button's pin */
+	/** @brief ativaçao de interrupçoes no pinos usados pelos butoes
+	 * 
+	 * Ativar o modo de interrupçao para os pinos relacionados com os butoes
+	*/
+	pins = bp->mask;
+	while (pins) {
+		pin = __builtin_ctz(pins);
+		ret = gpio_pin_interrupt_configure(bp->dev, pin, GPIO_INT_EDGE_TO_ACTIVE );
+		if (ret < 0) {
+			printk("Error: gpio_pin_interrupt_configure failed for %s pin %d, error:%d",
+			       bp->dev->name, pin, ret);
+			return ret;
+		}
+		pins &= pins - 1;
+	}
+
+	/* Initialize the struct gpio_callback variable   */
+	gpio_init_callback(&bp->cb, button_pressed, bp->mask);
+
+	/* Add the callback function by calling gpio_add_callback()   */
+	return gpio_add_callback(bp->dev, &bp->cb);
+}
+
+int buttons_init(struct event_ring *const rings[VM_LANES], struct k_sem *wake)
+{
+	int i, ret;
+
+	for (i = 0; i < VM_LANES; i++) {
+		buttons_ring[i] = rings[i];
+	}
+	buttons_wake = wake;
+
+#ifdef CONFIG_VENDING_ISR_TIMING
+	timing_init();
+	timing_start();
+#endif
+
+	for (i = 0; i < BUTTONS_PORTS; i++) {
+		ret = buttons_port_init(&ports[i], pin_code[i]);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/** @brief Arma com trigger os pinos com botao que nao estao a aguardar o debounce
+ * (os pinos em espera sao rearmados por flanco em debounce_port()).
+ * Chamada com debounce_lock adquirido. */
+static void buttons_arm_idle(gpio_flags_t trigger)
+{
+	uint32_t pins, pin;
+	int p;
+
+	for (p = 0; p < BUTTONS_PORTS; p++) {
+		pins = ports[p].mask & ~ports[p].pending;
+		while (pins) {
+			pin = __builtin_ctz(pins);
+			gpio_pin_interrupt_configure(ports[p].dev, pin, trigger);
+			pins &= pins - 1;
+		}
+	}
+}
+
+void buttons_suspend(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&debounce_lock);
+
+	sense_mode = true;
+	sensed = false;
+	/* Os pinos tem pull-up e sao ativos a 1: soltos estao no nivel ativo e o evento é gerado
+	 * ao soltar. Acorda-se pelo nivel da pressao (inativo); o evento continua a ser gerado
+	 * pelo flanco para ativo, rearmado em debounce_port() */
+	buttons_arm_idle(GPIO_INT_LEVEL_INACTIVE);
+	k_spin_unlock(&debounce_lock, key);
+}
+
+bool buttons_sensed(uint32_t *edge)
+{
+	k_spinlock_key_t key = k_spin_lock(&debounce_lock);
+	bool ret = sensed;
+
+	*edge = sensed_edge;
+	k_spin_unlock(&debounce_lock, key);
+	return ret;
+}
+
+void buttons_resume(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&debounce_lock);
+
+	sense_mode = false;
+	buttons_arm_idle(GPIO_INT_EDGE_TO_ACTIVE);
+	k_spin_unlock(&debounce_lock, key);
+}
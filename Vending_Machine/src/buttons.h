@@ -0,0 +1,104 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file buttons.h
+* \brief Botoes da maquina de venda: configuraçao dos pinos e descodificaçao pino -> evento
+*/
+
+#ifndef BUTTONS_H_
+#define BUTTONS_H_
+
+#include <zephyr.h>
+
+#include "vending.h"
+#include "event_ring.h"
+
+/** @brief Tempo de estabilizaçao (ms) dos moedeiros e das teclas */
+#define DEBOUNCE_COIN_MS CONFIG_VENDING_DEBOUNCE_COIN_MS
+#define DEBOUNCE_KEY_MS CONFIG_VENDING_DEBOUNCE_KEY_MS
+
+/** @brief Porta GPIO de cada painel: o painel 0 usa o GPIO0, os restantes o GPIO1 */
+#define BUTTONS_LANE_PORT(lane) ((lane) == 0 ? 0 : 1)
+/** @brief Numero de portas GPIO com botoes */
+#define BUTTONS_PORTS (VM_LANES > 1 ? 2 : 1)
+
+/** @brief Lista dos botoes do painel 0 (pino do GPIO0, evento gerado, tempo de estabilizaçao em ms)
+	* buttons 1-4 on board (11,12,24,25)
+	* buttons 5-8 connected labeled A0...A3 (gpio pin 3,4,28,29)
+	* a partir das listas dos paineis sao geradas, em tempo de compilaçao, as tabelas
+	* pino -> (painel, evento) e pino -> tempo de estabilizaçao de cada porta */
+#define BUTTONS_LANE0(X) \
+	X(0, 11, ADD1,  DEBOUNCE_COIN_MS)	/* add 1 euro */ \
+	X(0, 12, ADD2,  DEBOUNCE_COIN_MS)	/* add 2 euro */ \
+	X(0, 24, ADD5,  DEBOUNCE_COIN_MS)	/* add 5 euro */ \
+	X(0, 25, ADD10, DEBOUNCE_COIN_MS)	/* add 10 euro */ \
+	X(0, 3,  UP,    DEBOUNCE_KEY_MS)	/* Up */ \
+	X(0, 4,  DOWN,  DEBOUNCE_KEY_MS)	/* Down */ \
+	X(0, 28, SEL,   DEBOUNCE_KEY_MS)	/* Pay check */ \
+	X(0, 29, RET,   DEBOUNCE_KEY_MS)	/* Return */
+
+/** @brief Painel 1: P1.01 a P1.08 (mesma ordem de eventos do painel 0) */
+#define BUTTONS_LANE1(X) \
+	X(1, 1,  ADD1,  DEBOUNCE_COIN_MS) \
+	X(1, 2,  ADD2,  DEBOUNCE_COIN_MS) \
+	X(1, 3,  ADD5,  DEBOUNCE_COIN_MS) \
+	X(1, 4,  ADD10, DEBOUNCE_COIN_MS) \
+	X(1, 5,  UP,    DEBOUNCE_KEY_MS) \
+	X(1, 6,  DOWN,  DEBOUNCE_KEY_MS) \
+	X(1, 7,  SEL,   DEBOUNCE_KEY_MS) \
+	X(1, 8,  RET,   DEBOUNCE_KEY_MS)
+
+/** @brief Painel 2: P1.09 a P1.15 e P1.00 (P1.00 deixa de estar disponivel para o SWO) */
+#define BUTTONS_LANE2(X) \
+	X(2, 10, ADD1,  DEBOUNCE_COIN_MS) \
+	X(2, 11, ADD2,  DEBOUNCE_COIN_MS) \
+	X(2, 12, ADD5,  DEBOUNCE_COIN_MS) \
+	X(2, 13, ADD10, DEBOUNCE_COIN_MS) \
+	X(2, 14, UP,    DEBOUNCE_KEY_MS) \
+	X(2, 15, DOWN,  DEBOUNCE_KEY_MS) \
+	X(2, 9,  SEL,   DEBOUNCE_KEY_MS) \
+	X(2, 0,  RET,   DEBOUNCE_KEY_MS)
+
+/** @brief Botoes de todos os paineis ativos (CONFIG_VENDING_LANES) */
+#if VM_LANES > 2
+#define BUTTONS_LIST(X) BUTTONS_LANE0(X) BUTTONS_LANE1(X) BUTTONS_LANE2(X)
+#elif VM_LANES > 1
+#define BUTTONS_LIST(X) BUTTONS_LANE0(X) BUTTONS_LANE1(X)
+#else
+#define BUTTONS_LIST(X) BUTTONS_LANE0(X)
+#endif
+
+/** @brief Estatisticas da callback dos botoes (ciclos apenas com CONFIG_VENDING_ISR_TIMING) */
+struct buttons_isr_stats {
+	uint32_t calls;		/**< numero de execuçoes da callback (flancos) */
+	uint32_t max_cycles;	/**< pior caso (ciclos de CPU) */
+	uint64_t total_cycles;	/**< soma, para calcular a media */
+	uint32_t confirmed;	/**< pressoes confirmadas pelo debounce */
+	uint32_t rejected;	/**< pressoes rejeitadas (nivel inativo no fim do tempo de estabilizaçao) */
+};
+
+/** @brief Configura os pinos dos botoes e instala as callbacks
+ *
+ * Cada botao primido gera um evento na fila do seu painel (rings[painel]), depois de
+ * confirmado pelo debounce; depois dos eventos serem colocados na fila é dado o semaforo wake.
+ * @return 0 em caso de sucesso ou o erro do driver GPIO */
+int buttons_init(struct event_ring *const rings[VM_LANES], struct k_sem *wake);
+
+/** @brief Le as estatisticas da callback e do debounce */
+void buttons_isr_stats_get(struct buttons_isr_stats *st);
+
+/** @brief Baixo consumo: passa os botoes a interrupçoes por nivel
+ * No nRF o nivel usa o SENSE dos pinos (evento PORT) em vez de um canal GPIOTE IN por pino.
+ * Arma o nivel da pressao (os botoes soltos estao no nivel ativo): a primeira pressao acorda
+ * o CPU e a callback normal volta a armar esse pino por flanco, que gera o evento ao soltar. */
+void buttons_suspend(void);
+
+/** @brief Houve alguma pressao desde buttons_suspend()?
+ * @param edge instante (k_cycle_get_32) do primeiro flanco */
+bool buttons_sensed(uint32_t *edge);
+
+/** @brief Volta a armar por flanco os pinos que ainda estao por nivel */
+void buttons_resume(void);
+
+#endif /* BUTTONS_H_ */
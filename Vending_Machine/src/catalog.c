@@ -0,0 +1,558 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog.c
+* \brief Catalogo de sessoes: versao compilada (em flash) e versoes carregadas (em RAM)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+
+#include "catalog.h"
+
+#define CATALOG_MAX CONFIG_VENDING_CATALOG_MAX_SESSIONS
+
+/** @brief A vista das proximas sessoes tem de ser recalculada (catalogo novo) */
+#define UPCOMING_STALE 0xFF
+
+/* Listas de filmes, horas e preço */
+
+/** @brief Titulos dos filmes (pool de strings, o handle de cada titulo é o seu indice) */
+static const char *const Titulos[] = {
+	"O Regresso do Engenheiro",
+	"Noites de Maio",
+};
+
+/** @brief Lista de Filmes 
+ * array com o titulo (handle em Titulos[]) de cada sessao
+*/
+static const str_handle_t Movie[] = {0, 0, 0, 1, 1};
+/** @brief Lista das Horas 
+ * array com as horas das sessoes dos filmes 
+*/
+static const uint8_t Hora[] = {19, 21, 23, 19, 21};
+/** @brief Lista de Preços
+ * array com os preços relacionado a cada filme e sessao
+*/
+static const uint8_t Preco[] = {9, 11, 9, 10, 12};
+
+BUILD_ASSERT(ARRAY_SIZE(Movie) == ARRAY_SIZE(Hora) && ARRAY_SIZE(Hora) == ARRAY_SIZE(Preco),
+	     "catalog fields must have one entry per session");
+
+/** @brief Catalogo compilado na aplicaçao */
+static const struct catalog builtin_catalog = {
+	.count = ARRAY_SIZE(Movie),
+	.title = Movie,
+	.hour = Hora,
+	.price = Preco,
+};
+
+/** @brief Indices secundarios de um catalogo
+ * order[k] tem as sessoes ordenadas pela chave k (empates pela ordem do catalogo) e
+ * pos[k] é o inverso (posiçao de cada sessao em order[k]), para avançar em O(1) */
+struct catalog_index {
+	uint16_t order[CATALOG_NUM_KEYS][CATALOG_MAX];
+	uint16_t pos[CATALOG_NUM_KEYS][CATALOG_MAX];
+};
+
+/** @brief Banco de catalogo: descritor, indices e espaço para os campos de um catalogo
+ * carregado em tempo de execuçao (o catalogo compilado usa os arrays em flash)
+ * Os campos do banco 0 ficam por usar ate a segunda troca, mas sao necessarios: cada versao
+ * é carregada no banco que a maquina de estados nao esta a ler */
+struct catalog_bank {
+	struct catalog cat;
+	struct catalog_index idx;
+	uint32_t version;	/**< 0 = catalogo compilado, incrementa a cada troca */
+	uint32_t t_publish;	/**< instante da publicaçao (k_cycle_get_32) */
+	/** @brief Posiçao alfabetica do titulo de cada sessao entre os titulos do catalogo
+	 * (chave de CATALOG_BY_TITLE: os handles seguem a ordem de chegada ao pool) */
+	uint16_t title_rank[CATALOG_MAX];
+	str_handle_t title[CATALOG_MAX];
+	uint8_t hour[CATALOG_MAX];
+	uint8_t price[CATALOG_MAX];
+};
+
+/** @brief Dois bancos: um em uso e outro onde é carregada a versao seguinte */
+static struct catalog_bank banks[2];
+
+/** @brief Banco publicado pelo carregador (escrito so por catalog_stage_publish()) */
+static atomic_ptr_t published;
+/** @brief Banco que a maquina de estados esta a usar (escrito so por catalog_sync()) */
+static atomic_ptr_t in_use;
+/** @brief Copia local de in_use, lida pela maquina de estados sem operaçoes atomicas */
+static struct catalog_bank *cur;
+
+/** @brief Banco a ser carregado (NULL fora de catalog_stage_begin()..publish()) */
+static struct catalog_bank *staging;
+static uint16_t staged;
+
+static struct catalog_swap_stats swap_stats;
+
+/** @brief Vista das sessoes que ainda nao começaram: order[CATALOG_BY_HOUR][upcoming_first..n-1]
+ * (o indice por hora esta ordenado, por isso as sessoes que começaram sao sempre um prefixo) */
+static uint16_t upcoming_first;
+/** @brief Hora usada na ultima atualizaçao da vista (UPCOMING_STALE = recalcular) */
+static uint8_t upcoming_hour = UPCOMING_STALE;
+static uint32_t upcoming_dropped;
+
+const struct catalog *catalog_get(void)
+{
+	return &cur->cat;
+}
+
+/** @brief Valor da chave key para a sessao idx (c é sempre o descritor de um banco) */
+static inline uint16_t catalog_key_of(const struct catalog *c, enum catalog_key key, uint16_t idx)
+{
+	switch (key) {
+	case CATALOG_BY_TITLE:
+		return CONTAINER_OF(c, struct catalog_bank, cat)->title_rank[idx];
+	case CATALOG_BY_HOUR:
+		return catalog_hour(c, idx);
+	default:
+		return catalog_price(c, idx);
+	}
+}
+
+/** @brief A sessao a vem antes ou empata com b na ordem da chave
+ * os titulos sao comparados pelo texto: cada titulo tem um unico handle, pelo que titulos
+ * iguais empatam */
+static bool catalog_key_le(const struct catalog *c, enum catalog_key key, uint16_t a, uint16_t b)
+{
+	if (key == CATALOG_BY_TITLE) {
+		return strcmp(catalog_title_str(c, a), catalog_title_str(c, b)) <= 0;
+	}
+	return catalog_key_of(c, key, a) <= catalog_key_of(c, key, b);
+}
+
+/** @brief Ordena as sessoes pela chave (merge sort estavel, usa tmp como memoria auxiliar) */
+static void catalog_sort(const struct catalog *c, enum catalog_key key, uint16_t *order,
+			 uint16_t *tmp)
+{
+	uint16_t n = catalog_count(c);
+	uint16_t width, lo, mid, hi, i, j, k;
+	uint16_t *src = order, *dst = tmp, *swap;
+
+	for (i = 0; i < n; i++) {
+		order[i] = i;
+	}
+	for (width = 1; width < n; width *= 2) {
+		for (lo = 0; lo < n; lo += 2 * width) {
+			mid = MIN(lo + width, n);
+			hi = MIN(lo + 2 * width, n);
+			i = lo;
+			j = mid;
+			for (k = lo; k < hi; k++) {
+				if (i < mid && (j >= hi || catalog_key_le(c, key, src[i], src[j]))) {
+					dst[k] = src[i++];
+				} else {
+					dst[k] = src[j++];
+				}
+			}
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != order) {
+		memcpy(order, src, n * sizeof(order[0]));
+	}
+}
+
+/** @brief Constroi os indices do banco */
+static void catalog_build(struct catalog_bank *b)
+{
+	const struct catalog *c = &b->cat;
+	uint16_t n = catalog_count(c);
+	uint16_t rank = 0;
+	int k;
+	uint16_t i;
+
+	for (k = 0; k < CATALOG_NUM_KEYS; k++) {
+		/* pos[k] serve de memoria auxiliar da ordenaçao antes de ser preenchido */
+		catalog_sort(c, k, b->idx.order[k], b->idx.pos[k]);
+		for (i = 0; i < n; i++) {
+			b->idx.pos[k][b->idx.order[k][i]] = i;
+		}
+	}
+	/* Titulos por ordem alfabetica: a posiçao de cada um passa a ser a chave das pesquisas */
+	for (i = 0; i < n; i++) {
+		if (i > 0 && catalog_title(c, b->idx.order[CATALOG_BY_TITLE][i]) !=
+			     catalog_title(c, b->idx.order[CATALOG_BY_TITLE][i - 1])) {
+			rank++;
+		}
+		b->title_rank[b->idx.order[CATALOG_BY_TITLE][i]] = rank;
+	}
+}
+
+int catalog_init(void)
+{
+	uint16_t n = catalog_count(&builtin_catalog);
+
+	if (n > CATALOG_MAX) {
+		printk("Erro: catalogo com %u sessoes (maximo %u)\n", n, CATALOG_MAX);
+		return -ENOMEM;
+	}
+	if (strpool_init(Titulos, ARRAY_SIZE(Titulos)) < 0) {
+		return -ENOMEM;
+	}
+
+	banks[0].cat = builtin_catalog;
+	catalog_build(&banks[0]);
+	cur = &banks[0];
+	atomic_ptr_set(&published, cur);
+	atomic_ptr_set(&in_use, cur);
+
+	printk("Catalogo: %u sessoes, %u indices de %u bytes\n", n, CATALOG_NUM_KEYS,
+	       (uint32_t)catalog_index_size());
+	return 0;
+}
+
+size_t catalog_index_size(void)
+{
+	return sizeof(struct catalog_index) / CATALOG_NUM_KEYS;
+}
+
+bool catalog_sync(void)
+{
+	struct catalog_bank *b = atomic_ptr_get(&published);
+	uint32_t us;
+
+	if (b == cur) {
+		return false;
+	}
+	cur = b;
+	atomic_ptr_set(&in_use, b);
+	upcoming_first = 0;
+	upcoming_hour = UPCOMING_STALE;
+
+	us = k_cyc_to_us_floor32(k_cycle_get_32() - b->t_publish);
+	swap_stats.version = b->version;
+	swap_stats.swaps++;
+	swap_stats.switch_last_us = us;
+	swap_stats.switch_max_us = MAX(swap_stats.switch_max_us, us);
+	return true;
+}
+
+int catalog_stage_begin(uint16_t count)
+{
+	struct catalog_bank *pub = atomic_ptr_get(&published);
+
+	if (count == 0 || count > CATALOG_MAX) {
+		return -EINVAL;
+	}
+	/* A maquina de estados ainda usa o banco anterior a ultima troca, ou ha outra versao a
+	 * meio (ex.: uma atualizaçao incremental no meio de um CAT de texto): nao a destruir */
+	if (atomic_ptr_get(&in_use) != pub || staging != NULL) {
+		return -EBUSY;
+	}
+	staging = (pub == &banks[0]) ? &banks[1] : &banks[0];
+	staging->cat.count = count;
+	staging->cat.title = staging->title;
+	staging->cat.hour = staging->hour;
+	staging->cat.price = staging->price;
+	staged = 0;
+	return 0;
+}
+
+/** @brief Valor aceitavel para o campo */
+static bool catalog_field_valid(enum catalog_field f, uint16_t v)
+{
+	switch (f) {
+	case CATALOG_TITLE:
+		return strpool_valid(v);
+	case CATALOG_HOUR:
+		return v <= 23;
+	default:
+		return v > 0 && v <= UINT8_MAX;
+	}
+}
+
+int catalog_stage_check(uint8_t hour, uint8_t price)
+{
+	if (staging == NULL) {
+		return -EINVAL;
+	}
+	if (staged >= staging->cat.count) {
+		return -E2BIG;
+	}
+	if (!catalog_field_valid(CATALOG_HOUR, hour) || !catalog_field_valid(CATALOG_PRICE, price)) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int catalog_stage_add(str_handle_t title, uint8_t hour, uint8_t price)
+{
+	int ret = catalog_stage_check(hour, price);
+
+	if (ret < 0) {
+		return ret;
+	}
+	if (!catalog_field_valid(CATALOG_TITLE, title)) {
+		return -EINVAL;
+	}
+	staging->title[staged] = title;
+	staging->hour[staged] = hour;
+	staging->price[staged] = price;
+	staged++;
+	return 0;
+}
+
+int catalog_stage_clone(uint32_t base_version, uint16_t count, uint16_t *base_count)
+{
+	const struct catalog_bank *pub = atomic_ptr_get(&published);
+	uint16_t n;
+	int ret;
+
+	if (pub->version != base_version) {
+		return -ESTALE;
+	}
+	ret = catalog_stage_begin(count);
+	if (ret < 0) {
+		return ret;
+	}
+	n = MIN(count, catalog_count(&pub->cat));
+	memcpy(staging->title, pub->cat.title, n * sizeof(staging->title[0]));
+	memcpy(staging->hour, pub->cat.hour, n);
+	memcpy(staging->price, pub->cat.price, n);
+	*base_count = n;
+	/* As sessoes acrescentadas (n..count-1) tem de ser escritas com catalog_stage_patch() */
+	staged = count;
+	return 0;
+}
+
+int catalog_stage_patch(uint16_t idx, enum catalog_field f, uint16_t value)
+{
+	if (staging == NULL || idx >= staging->cat.count) {
+		return -EINVAL;
+	}
+	if (!catalog_field_valid(f, value)) {
+		return -EINVAL;
+	}
+	switch (f) {
+	case CATALOG_TITLE:
+		staging->title[idx] = value;
+		break;
+	case CATALOG_HOUR:
+		staging->hour[idx] = value;
+		break;
+	default:
+		staging->price[idx] = value;
+		break;
+	}
+	return 0;
+}
+
+uint16_t catalog_crc(const struct catalog *c)
+{
+	uint16_t crc = 0xffff;
+	const char *title;
+	uint8_t rec[2];
+	uint16_t i;
+
+	for (i = 0; i < catalog_count(c); i++) {
+		title = catalog_title_str(c, i);
+		rec[0] = catalog_hour(c, i);
+		rec[1] = catalog_price(c, i);
+		crc = crc16_ccitt(crc, (const uint8_t *)title, strlen(title) + 1);
+		crc = crc16_ccitt(crc, rec, sizeof(rec));
+	}
+	return crc;
+}
+
+size_t catalog_naive_title_bytes(const struct catalog *c)
+{
+	size_t bytes = 0;
+	uint16_t i;
+
+	for (i = 0; i < catalog_count(c); i++) {
+		bytes += strlen(catalog_title_str(c, i)) + 1;
+	}
+	return bytes;
+}
+
+uint16_t catalog_stage_crc(void)
+{
+	return staging ? catalog_crc(&staging->cat) : 0;
+}
+
+void catalog_stage_abort(void)
+{
+	staging = NULL;
+}
+
+int catalog_stage_publish(uint32_t version)
+{
+	uint32_t pub_version = ((struct catalog_bank *)atomic_ptr_get(&published))->version;
+	struct catalog_bank *b = staging;
+	uint32_t t0 = k_cycle_get_32();
+
+	if (b == NULL) {
+		return -EINVAL;
+	}
+	staging = NULL;
+	if (staged != b->cat.count) {
+		return -ENODATA;
+	}
+
+	if (version == 0U) {
+		version = pub_version + 1U;
+	} else if (version <= pub_version) {
+		return -ESTALE;
+	}
+
+	catalog_build(b);
+	b->version = version;
+	b->t_publish = k_cycle_get_32();
+	swap_stats.publish_us = k_cyc_to_us_floor32(b->t_publish - t0);
+	/* Os campos e indices ficam visiveis antes do ponteiro (atomic_ptr_set é seq_cst) */
+	atomic_ptr_set(&published, b);
+	return 0;
+}
+
+void catalog_swap_stats_get(struct catalog_swap_stats *st)
+{
+	*st = swap_stats;
+}
+
+/** @brief Primeira posiçao em order[key] com chave > value (ou >= se inclusive) */
+static uint16_t catalog_bound(const struct catalog *c, enum catalog_key key, uint16_t value,
+			      bool inclusive)
+{
+	const uint16_t *order = cur->idx.order[key];
+	uint16_t lo = 0, hi = catalog_count(c), mid;
+	uint16_t v;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		v = catalog_key_of(c, key, order[mid]);
+		if (v < value || (!inclusive && v == value)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+uint16_t catalog_next_group(enum catalog_key key, uint16_t idx)
+{
+	const struct catalog *c = catalog_get();
+	uint16_t p = catalog_bound(c, key, catalog_key_of(c, key, idx), false);
+
+	return cur->idx.order[key][p < catalog_count(c) ? p : 0];
+}
+
+uint16_t catalog_prev_group(enum catalog_key key, uint16_t idx)
+{
+	const struct catalog *c = catalog_get();
+	uint16_t p = catalog_bound(c, key, catalog_key_of(c, key, idx), true);
+	const uint16_t *order = cur->idx.order[key];
+
+	/* ultima sessao do grupo anterior (ou do ultimo grupo) e depois o inicio desse grupo */
+	p = (p > 0) ? p - 1 : catalog_count(c) - 1;
+	return order[catalog_bound(c, key, catalog_key_of(c, key, order[p]), true)];
+}
+
+uint16_t catalog_next_in_group(enum catalog_key key, uint16_t idx)
+{
+	const struct catalog *c = catalog_get();
+	const uint16_t *order = cur->idx.order[key];
+	uint16_t p = cur->idx.pos[key][idx] + 1;
+	uint16_t value = catalog_key_of(c, key, idx);
+
+	if (p < catalog_count(c) && catalog_key_of(c, key, order[p]) == value) {
+		return order[p];
+	}
+	return order[catalog_bound(c, key, value, true)];
+}
+
+/* Chave usada por catalog_browse() */
+#if defined(CONFIG_VENDING_BROWSE_BY_TITLE)
+#define BROWSE_KEY CATALOG_BY_TITLE
+#elif defined(CONFIG_VENDING_BROWSE_BY_HOUR)
+#define BROWSE_KEY CATALOG_BY_HOUR
+#elif defined(CONFIG_VENDING_BROWSE_BY_PRICE)
+#define BROWSE_KEY CATALOG_BY_PRICE
+#endif
+
+void catalog_upcoming_update(uint8_t hour_now)
+{
+	const uint16_t *order = cur->idx.order[CATALOG_BY_HOUR];
+	uint16_t n = catalog_count(&cur->cat);
+	uint16_t first = upcoming_first;
+
+	if (hour_now == upcoming_hour) {
+		return;
+	}
+	if (upcoming_hour == UPCOMING_STALE || hour_now < upcoming_hour) {
+		/* catalogo novo ou dia novo: pesquisa binaria pela primeira sessao depois da hora */
+		upcoming_first = catalog_bound(&cur->cat, CATALOG_BY_HOUR, hour_now, false);
+	} else {
+		/* a hora avançou: retirar so as sessoes que começaram entretanto */
+		while (first < n && catalog_hour(&cur->cat, order[first]) <= hour_now) {
+			first++;
+		}
+		upcoming_dropped += first - upcoming_first;
+		upcoming_first = first;
+	}
+	upcoming_hour = hour_now;
+}
+
+bool catalog_bookable(uint16_t idx)
+{
+	return cur->idx.pos[CATALOG_BY_HOUR][idx] >= upcoming_first;
+}
+
+uint16_t catalog_upcoming_count(void)
+{
+	return catalog_count(&cur->cat) - upcoming_first;
+}
+
+uint16_t catalog_upcoming_first(void)
+{
+	return catalog_upcoming_count() ? cur->idx.order[CATALOG_BY_HOUR][upcoming_first] : 0;
+}
+
+uint32_t catalog_upcoming_dropped(void)
+{
+	return upcoming_dropped;
+}
+
+#ifdef CONFIG_VENDING_BROWSE_UPCOMING
+/** @brief Sessao seguinte/anterior na vista das proximas sessoes, por hora de inicio (O(1)) */
+static uint16_t catalog_upcoming_step(uint16_t idx, bool up)
+{
+	const uint16_t *order = cur->idx.order[CATALOG_BY_HOUR];
+	uint16_t n = catalog_count(&cur->cat);
+	uint16_t p = cur->idx.pos[CATALOG_BY_HOUR][idx];
+
+	if (upcoming_first >= n) {
+		return idx;
+	}
+	if (p < upcoming_first) {
+		/* a sessao selecionada começou entretanto */
+		return order[upcoming_first];
+	}
+	if (up) {
+		return order[(p + 1U < n) ? p + 1U : upcoming_first];
+	}
+	return order[(p > upcoming_first) ? p - 1U : n - 1U];
+}
+#endif /* CONFIG_VENDING_BROWSE_UPCOMING */
+
+uint16_t catalog_browse(uint16_t idx, bool up)
+{
+#if defined(CONFIG_VENDING_BROWSE_UPCOMING)
+	return catalog_upcoming_step(idx, up);
+#elif defined(BROWSE_KEY)
+	return up ? catalog_next_group(BROWSE_KEY, idx) : catalog_next_in_group(BROWSE_KEY, idx);
+#else
+	const struct catalog *c = catalog_get();
+
+	return up ? catalog_next(c, idx) : catalog_prev(c, idx);
+#endif
+}
@@ -0,0 +1,199 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog.h
+* \brief Catalogo de sessoes (filme, hora, preço)
+*
+* O catalogo é guardado como estrutura de arrays (um array por campo). O catalogo compilado
+* é const, fica em flash e é lido diretamente (XIP) sem copia para RAM. O acesso faz-se
+* sempre pelas funçoes abaixo.
+*
+* Uma versao nova pode ser carregada sem reiniciar (catalog_stage_*()): é escrita no banco
+* que nao esta em uso e publicada com a troca atomica de um ponteiro. Cada um dos dois
+* bancos tem em RAM os indices e os campos de CONFIG_VENDING_CATALOG_MAX_SESSIONS sessoes
+* (18 bytes por sessao), pelo que a RAM depende desse maximo e nao do numero de sessoes
+* carregadas. Os bancos alternam a cada troca: o banco 0 começa com o catalogo compilado
+* e os seus arrays de campos so sao usados a partir da segunda troca. A maquina de estados
+* so passa a ver a versao nova quando chama catalog_sync() entre eventos, pelo que nunca
+* le um catalogo a meio de ser escrito nem muda de catalogo a meio de uma transiçao.
+*/
+
+#ifndef CATALOG_H_
+#define CATALOG_H_
+
+#include <zephyr.h>
+
+#include "strpool.h"
+
+/** @brief Descritor de um catalogo: numero de sessoes e um array por campo */
+struct catalog {
+	uint16_t count;		/**< numero de sessoes */
+	const str_handle_t *title;	/**< titulo do filme de cada sessao (pool de strings) */
+	const uint8_t *hour;	/**< hora da sessao */
+	const uint8_t *price;	/**< preço em EUR */
+};
+
+/** @brief Chaves dos indices secundarios (titulos por ordem alfabetica, horas e preços
+ * por ordem crescente) */
+enum catalog_key {
+	CATALOG_BY_TITLE,
+	CATALOG_BY_HOUR,
+	CATALOG_BY_PRICE,
+	CATALOG_NUM_KEYS
+};
+
+/** @brief Campos de uma sessao (para alterar um campo de uma versao em carregamento) */
+enum catalog_field {
+	CATALOG_TITLE,
+	CATALOG_HOUR,
+	CATALOG_PRICE,
+};
+
+/** @brief Estatisticas das trocas de catalogo */
+struct catalog_swap_stats {
+	uint32_t version;	/**< versao em uso (0 = compilada) */
+	uint32_t swaps;		/**< trocas feitas */
+	uint32_t publish_us;	/**< construçao dos indices e publicaçao da ultima versao */
+	uint32_t switch_last_us;	/**< publicaçao -> maquina de estados a usar a versao nova */
+	uint32_t switch_max_us;
+};
+
+/** @brief Catalogo em uso pela maquina de estados */
+const struct catalog *catalog_get(void);
+
+/** @brief Carrega o catalogo: constroi os indices ordenados por filme, hora e preço
+ * @return 0 ou -ENOMEM se o catalogo tiver mais sessoes que CONFIG_VENDING_CATALOG_MAX_SESSIONS */
+int catalog_init(void);
+
+/** @brief Passa a usar a ultima versao publicada (so na thread da maquina de estados)
+ * @return true se o catalogo mudou desde a chamada anterior */
+bool catalog_sync(void);
+
+/** @brief Começa a carregar uma versao com count sessoes no banco livre
+ * @return 0, -EINVAL (count invalido) ou -EBUSY (troca anterior ainda nao vista por
+ * catalog_sync(), ou outra versao em carregamento: terminar ou chamar catalog_stage_abort()) */
+int catalog_stage_begin(uint16_t count);
+
+/** @brief Verifica se a sessao seguinte pode ser acrescentada com esta hora e preço, antes de
+ * o titulo ser guardado no pool de strings
+ * @return 0, -E2BIG (mais sessoes que as anunciadas) ou -EINVAL (campo invalido) */
+int catalog_stage_check(uint8_t hour, uint8_t price);
+
+/** @brief Acrescenta a sessao seguinte a versao em carregamento
+ * @return 0, -E2BIG (mais sessoes que as anunciadas) ou -EINVAL (campo invalido) */
+int catalog_stage_add(str_handle_t title, uint8_t hour, uint8_t price);
+
+/** @brief Começa uma versao nova como copia da versao publicada (atualizaçao incremental)
+ * as sessoes ate count mantem os valores atuais; as acrescentadas devem ser todas escritas
+ * com catalog_stage_patch() antes de publicar
+ * @param base_count devolve o numero de sessoes copiadas da versao base
+ * @return 0, -ESTALE (a versao publicada nao é base_version) ou erro de catalog_stage_begin() */
+int catalog_stage_clone(uint32_t base_version, uint16_t count, uint16_t *base_count);
+
+/** @brief Altera um campo de uma sessao da versao em carregamento
+ * @return 0 ou -EINVAL (sessao ou valor invalido) */
+int catalog_stage_patch(uint16_t idx, enum catalog_field f, uint16_t value);
+
+/** @brief CRC16 (CCITT, semente 0xffff) das sessoes de um catalogo
+ * por sessao: titulo com o terminador, hora e preço */
+uint16_t catalog_crc(const struct catalog *c);
+
+/** @brief CRC16 da versao em carregamento (ver catalog_crc()) */
+uint16_t catalog_stage_crc(void);
+
+/** @brief Bytes que os titulos ocupariam guardados como uma string por sessao */
+size_t catalog_naive_title_bytes(const struct catalog *c);
+
+/** @brief Abandona a versao em carregamento */
+void catalog_stage_abort(void);
+
+/** @brief Valida a versao carregada, constroi os indices e publica-a
+ * @param version numero da versao nova (0 = versao publicada + 1)
+ * @return 0, -ENODATA se faltarem sessoes ou -ESTALE se version nao for mais recente */
+int catalog_stage_publish(uint32_t version);
+
+/** @brief Le as estatisticas das trocas */
+void catalog_swap_stats_get(struct catalog_swap_stats *st);
+
+/** @brief Memoria (bytes) ocupada por cada indice secundario */
+size_t catalog_index_size(void);
+
+/** @brief Primeira sessao, segundo a chave, do grupo seguinte ao de idx (O(log n), circular)
+ * ex.: com CATALOG_BY_TITLE salta para a primeira sessao do filme seguinte */
+uint16_t catalog_next_group(enum catalog_key key, uint16_t idx);
+
+/** @brief Primeira sessao, segundo a chave, do grupo anterior ao de idx (O(log n), circular) */
+uint16_t catalog_prev_group(enum catalog_key key, uint16_t idx);
+
+/** @brief Sessao seguinte a idx dentro do mesmo grupo (O(1), volta ao inicio do grupo) */
+uint16_t catalog_next_in_group(enum catalog_key key, uint16_t idx);
+
+/** @brief Atualiza a vista das sessoes que ainda nao começaram (thread da maquina de estados)
+ * chamada a cada evento; so faz trabalho quando a hora muda, e entao retira apenas as
+ * sessoes que começaram (ou faz uma pesquisa binaria, depois de uma troca de catalogo ou
+ * à meia-noite) */
+void catalog_upcoming_update(uint8_t hour_now);
+
+/** @brief A sessao ainda nao começou (O(1)) */
+bool catalog_bookable(uint16_t idx);
+
+/** @brief Numero de sessoes que ainda nao começaram */
+uint16_t catalog_upcoming_count(void);
+
+/** @brief Proxima sessao a começar (0 se ja nao houver) */
+uint16_t catalog_upcoming_first(void);
+
+/** @brief Sessoes retiradas da vista desde o arranque */
+uint32_t catalog_upcoming_dropped(void);
+
+/** @brief Navegaçao com as teclas UP/DOWN segundo o modo CONFIG_VENDING_BROWSE_*
+ *
+ * Por sessao: UP/DOWN avançam/recuam uma sessao. Por filme, hora ou preço: UP salta para o
+ * grupo seguinte e DOWN percorre as sessoes do grupo atual. Proximas sessoes: UP/DOWN
+ * avançam/recuam pela hora de inicio, so entre as sessoes que ainda nao começaram. */
+uint16_t catalog_browse(uint16_t idx, bool up);
+
+/** @brief Numero de sessoes do catalogo */
+static inline uint16_t catalog_count(const struct catalog *c)
+{
+	return c->count;
+}
+
+/** @brief Titulo (handle no pool de strings) do filme da sessao idx */
+static inline str_handle_t catalog_title(const struct catalog *c, uint16_t idx)
+{
+	return c->title[idx];
+}
+
+/** @brief Titulo do filme da sessao idx (aponta para o pool, sem copia) */
+static inline const char *catalog_title_str(const struct catalog *c, uint16_t idx)
+{
+	return strpool_get(c->title[idx]);
+}
+
+/** @brief Hora da sessao idx */
+static inline uint8_t catalog_hour(const struct catalog *c, uint16_t idx)
+{
+	return c->hour[idx];
+}
+
+/** @brief Preço (EUR) da sessao idx */
+static inline uint8_t catalog_price(const struct catalog *c, uint16_t idx)
+{
+	return c->price[idx];
+}
+
+/** @brief Sessao seguinte a idx (circular) */
+static inline uint16_t catalog_next(const struct catalog *c, uint16_t idx)
+{
+	return (idx + 1U < c->count) ? idx + 1U : 0U;
+}
+
+/** @brief Sessao anterior a idx (circular) */
+static inline uint16_t catalog_prev(const struct catalog *c, uint16_t idx)
+{
+	return (idx > 0U) ? idx - 1U : c->count - 1U;
+}
+
+#endif /* CATALOG_H_ */
@@ -0,0 +1,209 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_delta.c
+* \brief Aplicaçao das atualizaçoes incrementais à medida que chegam (ver catalog_delta.h)
+*/
+
+#include <errno.h>
+#include <zephyr.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "catalog.h"
+#include "catalog_delta.h"
+#include "strpool.h"
+
+/** @brief Cabeçalho depois da marca: versoes, sessoes, CRC e tamanho das operaçoes */
+#define DELTA_HDR_SIZE 14
+
+enum delta_op {
+	DELTA_SKIP,
+	DELTA_PRICE,
+	DELTA_HOUR,
+	DELTA_FULL,
+};
+
+/** @brief Estado do interpretador (a mensagem nunca é guardada inteira) */
+static struct {
+	bool active;
+	uint8_t hdr[DELTA_HDR_SIZE];
+	uint8_t hdr_len;
+	uint32_t version;
+	uint16_t count;		/**< sessoes da versao nova */
+	uint16_t base_count;	/**< sessoes da versao base */
+	uint16_t crc;
+	uint16_t remaining;	/**< bytes de operaçoes por receber */
+	uint16_t cursor;	/**< sessao a que se aplica o proximo dado */
+	uint8_t op;		/**< operaçao em curso */
+	uint8_t left;		/**< sessoes que faltam na operaçao em curso (0 = espera operaçao) */
+	uint8_t field;		/**< campo seguinte de uma sessao FULL (hora, preço, tamanho, titulo) */
+	uint8_t title_len;	/**< tamanho do titulo da sessao FULL em curso */
+	uint8_t title_got;
+	char title[STRPOOL_MAX_LEN];
+	bool staged;		/**< o banco livre é desta atualizaçao (catalog_stage_clone() aceite) */
+	int err;		/**< primeiro erro (os bytes restantes sao consumidos e ignorados) */
+	uint32_t bytes;
+	uint32_t cycles;
+} d;
+
+static struct catalog_delta_stats stats;
+
+bool catalog_delta_active(void)
+{
+	return d.active;
+}
+
+/** @brief Interpreta o cabeçalho e prepara o banco livre como copia da versao base */
+static void delta_header(void)
+{
+	uint32_t base = sys_get_le32(&d.hdr[0]);
+
+	d.version = sys_get_le32(&d.hdr[4]);
+	d.count = sys_get_le16(&d.hdr[8]);
+	d.crc = sys_get_le16(&d.hdr[10]);
+	d.remaining = sys_get_le16(&d.hdr[12]);
+	d.cursor = 0;
+	d.left = 0;
+	d.err = catalog_stage_clone(base, d.count, &d.base_count);
+	d.staged = d.err == 0;
+}
+
+/** @brief Aplica um byte de dados da operaçao em curso */
+static int delta_data(uint8_t c)
+{
+	int ret;
+
+	if (d.cursor >= d.count) {
+		return -E2BIG;
+	}
+	switch (d.op) {
+	case DELTA_PRICE:
+		ret = catalog_stage_patch(d.cursor, CATALOG_PRICE, c);
+		break;
+	case DELTA_HOUR:
+		ret = catalog_stage_patch(d.cursor, CATALOG_HOUR, c);
+		break;
+	default:
+		/* FULL: hora, preço, tamanho do titulo e titulo */
+		switch (d.field++) {
+		case 0:
+			return catalog_stage_patch(d.cursor, CATALOG_HOUR, c);
+		case 1:
+			return catalog_stage_patch(d.cursor, CATALOG_PRICE, c);
+		case 2:
+			if (c == 0 || c > STRPOOL_MAX_LEN) {
+				return -EINVAL;
+			}
+			d.title_len = c;
+			d.title_got = 0;
+			return 0;
+		default:
+			d.title[d.title_got++] = (char)c;
+			if (d.title_got < d.title_len) {
+				return 0;
+			}
+			ret = strpool_intern(d.title, d.title_len);
+			if (ret >= 0) {
+				ret = catalog_stage_patch(d.cursor, CATALOG_TITLE, ret);
+			}
+			d.field = 0;
+			break;
+		}
+		break;
+	}
+	d.cursor++;
+	d.left--;
+	return ret;
+}
+
+/** @brief Byte de operaçao: SKIP aplica-se logo, as outras esperam pelos dados */
+static int delta_op(uint8_t c)
+{
+	uint8_t n = (c & 0x3f) + 1;
+
+	d.op = c >> 6;
+	if (d.op == DELTA_SKIP) {
+		if (d.cursor + n > d.base_count) {
+			/* sessoes novas nao podem ficar por escrever */
+			return -EINVAL;
+		}
+		d.cursor += n;
+		return 0;
+	}
+	if (d.op != DELTA_FULL && d.cursor + n > d.base_count) {
+		return -EINVAL;
+	}
+	d.left = n;
+	d.field = 0;
+	return 0;
+}
+
+/** @brief Fim das operaçoes: verificar o resultado e publicar */
+static int delta_finish(void)
+{
+	int ret = d.err;
+
+	d.active = false;
+	if (ret == 0 && (d.cursor != d.count || d.left != 0)) {
+		ret = -ENODATA;
+	}
+	if (ret == 0 && catalog_stage_crc() != d.crc) {
+		ret = -EBADMSG;
+	}
+	stats.last_bytes = d.bytes;
+	stats.last_apply_us = k_cyc_to_us_floor32(d.cycles);
+	if (ret == 0) {
+		ret = catalog_stage_publish(d.version);
+	} else if (d.staged) {
+		/* So abandonar a versao desta atualizaçao: com -EBUSY o banco é de um CAT de texto */
+		catalog_stage_abort();
+	}
+	if (ret < 0) {
+		stats.rejected++;
+		return ret;
+	}
+	stats.applied++;
+	return 1;
+}
+
+int catalog_delta_byte(uint8_t c)
+{
+	uint32_t t0 = k_cycle_get_32();
+	int ret = 0;
+
+	if (!d.active) {
+		/* marca */
+		d.active = true;
+		d.hdr_len = 0;
+		d.err = 0;
+		d.staged = false;
+		d.bytes = 1;
+		d.cycles = 0;
+		return 0;
+	}
+	d.bytes++;
+
+	if (d.hdr_len < DELTA_HDR_SIZE) {
+		d.hdr[d.hdr_len++] = c;
+		if (d.hdr_len == DELTA_HDR_SIZE) {
+			delta_header();
+		}
+	} else {
+		d.remaining--;
+		if (d.err == 0) {
+			d.err = d.left ? delta_data(c) : delta_op(c);
+		}
+	}
+	d.cycles += k_cycle_get_32() - t0;
+
+	if (d.hdr_len == DELTA_HDR_SIZE && d.remaining == 0) {
+		ret = delta_finish();
+	}
+	return ret;
+}
+
+void catalog_delta_stats_get(struct catalog_delta_stats *st)
+{
+	*st = stats;
+}
@@ -0,0 +1,59 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_delta.h
+* \brief Atualizaçao incremental (binaria) do catalogo
+*
+* Uma atualizaçao descreve so as diferenças para a versao publicada. Formato (little endian):
+*
+*     0xCD                         marca (nunca aparece no inicio de uma linha de texto)
+*     u32 versao base              tem de ser a versao publicada
+*     u32 versao nova
+*     u16 sessoes da versao nova
+*     u16 CRC16 da versao nova     catalog_crc()
+*     u16 bytes de operaçoes
+*     operaçoes
+*
+* Cada operaçao é um byte (tipo nos 2 bits de cima, n-1 nos 6 de baixo) seguido dos dados
+* de n sessoes consecutivas a partir do cursor (começa em 0):
+*
+*     SKIP  (0) n sessoes sem alteraçoes, sem dados
+*     PRICE (1) n preços, 1 byte cada
+*     HOUR  (2) n horas, 1 byte cada
+*     FULL  (3) n sessoes completas: hora, preço, u8 tamanho do titulo e o titulo (sem
+*               terminador); obrigatorio para sessoes novas
+*
+* No fim o cursor tem de estar no numero de sessoes. As operaçoes sao aplicadas à medida que
+* os bytes chegam, diretamente no banco livre (copia da versao base), sem guardar a mensagem;
+* a versao so é publicada se o CRC do resultado coincidir. Uma atualizaçao que chegue a meio
+* de um CAT de texto é rejeitada com -EBUSY e o CAT continua.
+*/
+
+#ifndef CATALOG_DELTA_H_
+#define CATALOG_DELTA_H_
+
+#include <zephyr.h>
+
+/** @brief Primeiro byte de uma atualizaçao incremental */
+#define CATALOG_DELTA_MAGIC 0xCD
+
+/** @brief Estatisticas das atualizaçoes incrementais */
+struct catalog_delta_stats {
+	uint32_t applied;	/**< atualizaçoes publicadas */
+	uint32_t rejected;	/**< atualizaçoes rejeitadas (versao, CRC, formato) */
+	uint32_t last_bytes;	/**< bytes da ultima atualizaçao, incluindo o cabeçalho */
+	uint32_t last_apply_us;	/**< tempo de CPU a aplicar as operaçoes da ultima */
+};
+
+/** @brief Ha uma atualizaçao a meio de ser recebida */
+bool catalog_delta_active(void);
+
+/** @brief Trata o byte seguinte (o primeiro é CATALOG_DELTA_MAGIC)
+ * @return 0 se a atualizaçao continua, 1 se foi publicada, erro negativo se foi rejeitada */
+int catalog_delta_byte(uint8_t c);
+
+/** @brief Le as estatisticas */
+void catalog_delta_stats_get(struct catalog_delta_stats *st);
+
+#endif /* CATALOG_DELTA_H_ */
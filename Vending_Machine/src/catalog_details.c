@@ -0,0 +1,124 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_details.c
+* \brief Paginas LZ4 com os detalhes dos filmes e cache LRU (ver catalog_details.h)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr.h>
+#include <zephyr/sys/byteorder.h>
+#include <lz4.h>
+
+#include "catalog_details.h"
+
+/** @brief Pagina comprimida em page_data */
+struct catalog_page {
+	uint32_t offset;	/**< inicio em page_data */
+	uint16_t size;		/**< bytes comprimidos */
+	uint16_t raw;		/**< bytes descomprimidos */
+};
+
+/* film_title[], page_data[], pages[] e as constantes CATALOG_* */
+#include "catalog_pages.inc"
+
+#define CACHE_SLOTS CONFIG_VENDING_CATALOG_PAGE_CACHE
+
+/** @brief Pagina descomprimida na cache */
+struct page_slot {
+	int16_t page;		/**< pagina guardada (-1 = livre) */
+	uint32_t used;		/**< instante do ultimo acesso (contador de acessos) */
+	uint8_t data[CATALOG_PAGE_MAX];
+};
+
+static struct page_slot cache[CACHE_SLOTS] = {
+	[0 ... CACHE_SLOTS - 1] = { .page = -1 },
+};
+static uint32_t access_clock;
+static struct catalog_details_stats stats = {
+	.raw_bytes = CATALOG_RAW_BYTES,
+	.packed_bytes = CATALOG_PACKED_BYTES,
+};
+
+/** @brief Indice do filme em film_title[] (pesquisa binaria, a tabela esta ordenada) */
+static int film_index(const char *title)
+{
+	int lo = 0, hi = CATALOG_FILMS, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(film_title[mid], title) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo < CATALOG_FILMS && strcmp(film_title[lo], title) == 0) ? lo : -ENOENT;
+}
+
+/** @brief Pagina na cache: devolve-a se ja la estiver, senao descomprime-a para a entrada
+ * usada ha mais tempo */
+static struct page_slot *page_get(int page)
+{
+	struct page_slot *victim = &cache[0];
+	int i, n;
+
+	access_clock++;
+	for (i = 0; i < CACHE_SLOTS; i++) {
+		if (cache[i].page == page) {
+			cache[i].used = access_clock;
+			stats.hits++;
+			return &cache[i];
+		}
+		/* entrada livre, ou a usada ha mais tempo */
+		if (victim->page >= 0 && (cache[i].page < 0 || cache[i].used < victim->used)) {
+			victim = &cache[i];
+		}
+	}
+
+	stats.misses++;
+	n = LZ4_decompress_safe((const char *)&page_data[pages[page].offset], (char *)victim->data,
+				pages[page].size, sizeof(victim->data));
+	if (n != pages[page].raw) {
+		victim->page = -1;
+		stats.errors++;
+		return NULL;
+	}
+	victim->page = page;
+	victim->used = access_clock;
+	return victim;
+}
+
+int catalog_details_get(const char *title, struct catalog_details *d)
+{
+	uint32_t t0 = k_cycle_get_32();
+	struct page_slot *slot;
+	const char *p;
+	int film = film_index(title);
+	uint32_t us;
+
+	if (film < 0) {
+		return film;
+	}
+	slot = page_get(film / CATALOG_PAGE_FILMS);
+	if (slot == NULL) {
+		return -EIO;
+	}
+
+	/* u16 numero de filmes, u16 inicio de cada filme, depois as strings de cada filme */
+	p = (const char *)&slot->data[sys_get_le16(&slot->data[2 + 2 * (film % CATALOG_PAGE_FILMS)])];
+	d->rating = p;
+	p += strlen(p) + 1;
+	d->synopsis = p;
+
+	us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+	stats.lookup_max_us = MAX(stats.lookup_max_us, us);
+	return 0;
+}
+
+void catalog_details_stats_get(struct catalog_details_stats *st)
+{
+	*st = stats;
+}
@@ -0,0 +1,56 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_details.h
+* \brief Detalhes dos filmes (classificaçao, sinopse) em paginas comprimidas
+*
+* Os detalhes sao gerados na compilaçao a partir de catalog/films.csv por
+* scripts/catalog_pack.py: os filmes, ordenados pelo titulo usado no catalogo, sao agrupados
+* em paginas e cada pagina é comprimida como um bloco LZ4 independente em flash. Uma pagina
+* so é descomprimida quando um dos seus filmes é apresentado, para uma cache LRU de
+* CONFIG_VENDING_CATALOG_PAGE_CACHE paginas em RAM. Como sao indexados pelo titulo do filme,
+* os detalhes continuam validos depois de uma troca de catalogo.
+*/
+
+#ifndef CATALOG_DETAILS_H_
+#define CATALOG_DETAILS_H_
+
+#include <errno.h>
+#include <zephyr.h>
+
+/** @brief Detalhes de um filme (apontam para a cache: validos ate à chamada seguinte) */
+struct catalog_details {
+	const char *rating;
+	const char *synopsis;
+};
+
+/** @brief Estatisticas da cache de paginas */
+struct catalog_details_stats {
+	uint32_t raw_bytes;	/**< tamanho das paginas descomprimidas */
+	uint32_t packed_bytes;	/**< tamanho em flash */
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t errors;	/**< paginas que nao descomprimiram */
+	uint32_t lookup_max_us;	/**< pior consulta (inclui a descompressao) */
+};
+
+#ifdef CONFIG_VENDING_CATALOG_DETAILS
+
+/** @brief Procura os detalhes do filme
+ * @return 0, -ENOENT (filme sem detalhes) ou -EIO (pagina corrompida) */
+int catalog_details_get(const char *title, struct catalog_details *d);
+
+/** @brief Le as estatisticas da cache */
+void catalog_details_stats_get(struct catalog_details_stats *st);
+
+#else
+
+static inline int catalog_details_get(const char *title, struct catalog_details *d)
+{
+	return -ENOENT;
+}
+
+#endif /* CONFIG_VENDING_CATALOG_DETAILS */
+
+#endif /* CATALOG_DETAILS_H_ */
@@ -0,0 +1,77 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_file.c
+* \brief Fonte do catalogo em native_posix: ficheiro do host indicado por -catalog=<ficheiro>
+*
+* O ficheiro é lido uma vez, quando main() indica que a maquina de estados ja esta a
+* funcionar (catalog_file_ready()), e entregue ao carregador pelo mesmo caminho que os
+* bytes da UART.
+*/
+
+#include <stdio.h>
+#include <zephyr.h>
+#include <zephyr/sys/printk.h>
+
+#include "cmdline.h"
+#include "soc.h"
+
+#include "catalog_loader.h"
+
+static char *catalog_path;
+static K_SEM_DEFINE(catalog_file_go, 0, 1);
+
+static void catalog_file_options(void)
+{
+	static struct args_struct_t catalog_options[] = {
+		{ .manual = false, .is_mandatory = false, .is_switch = false,
+		  .option = "catalog", .name = "path", .type = 's',
+		  .dest = (void *)&catalog_path, .call_when_found = NULL,
+		  .descript = "Catalog file loaded at runtime (CAT/END text format)" },
+		ARG_TABLE_ENDMARKER
+	};
+
+	native_add_command_line_opts(catalog_options);
+}
+
+NATIVE_TASK(catalog_file_options, PRE_BOOT_1, 1);
+
+void catalog_file_ready(void)
+{
+	k_sem_give(&catalog_file_go);
+}
+
+static void catalog_file_thread(void *p1, void *p2, void *p3)
+{
+	uint8_t buf[32];
+	size_t n, done;
+	FILE *f;
+
+	if (catalog_path == NULL) {
+		return;
+	}
+	/* Esperar que main() tenha o catalogo compilado em uso e a thread vm_fsm iniciada */
+	k_sem_take(&catalog_file_go, K_FOREVER);
+
+	f = fopen(catalog_path, "r");
+	if (f == NULL) {
+		printk("Catalogo: nao foi possivel abrir %s\n", catalog_path);
+		return;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+		for (done = 0; done < n; ) {
+			done += catalog_loader_feed(buf + done, n - done);
+			if (done < n) {
+				/* buffer do carregador cheio: deixar a work queue avançar */
+				k_sleep(K_MSEC(1));
+			}
+		}
+	}
+	/* ultima linha sem fim de linha */
+	catalog_loader_feed((const uint8_t *)"\n", 1);
+	fclose(f);
+}
+
+K_THREAD_DEFINE(catalog_file, 1024, catalog_file_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
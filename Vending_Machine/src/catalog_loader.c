@@ -0,0 +1,230 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_loader.c
+* \brief Interpretaçao do catalogo recebido em texto (ver catalog_loader.h)
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include "catalog.h"
+#include "catalog_loader.h"
+#include "catalog_delta.h"
+#include "output.h"
+#include "wallclock.h"
+#include "recorder.h"
+
+/** @brief Comprimento maximo de uma linha: hora, preço e titulo */
+#define LOADER_LINE_MAX (8 + STRPOOL_MAX_LEN + 1)
+
+/** @brief Bytes recebidos à espera da work queue */
+RING_BUF_DECLARE(loader_rx, 256);
+static struct k_spinlock loader_lock;
+
+static struct event_ring *loader_ring;
+static struct k_sem *loader_wake;
+
+/** @brief Linha em construçao */
+static char line[LOADER_LINE_MAX];
+static uint8_t line_len;
+/** @brief Linha demasiado longa: ignorar ate ao fim */
+static bool line_overflow;
+/** @brief Entre CAT e END */
+static bool loading;
+/** @brief Bytes recusados por falta de espaço no buffer (perdidos, se vierem da UART) */
+static uint32_t rx_refused;
+
+static void loader_work_fn(struct k_work *work);
+static K_WORK_DEFINE(loader_work, loader_work_fn);
+
+/** @brief Thread (workqueue) do carregador: o parsing, os indices e o CRC de um catalogo
+ * completo demoram; na workqueue do sistema (cooperativa) atrasariam a maquina de estados */
+static K_THREAD_STACK_DEFINE(loader_stack, CONFIG_VENDING_CATALOG_LOADER_STACK_SIZE);
+static struct k_work_q loader_q;
+
+/** @brief Le um numero decimal de *p e avança *p; -1 se nao houver numero */
+static long parse_num(const char **p)
+{
+	char *end;
+	long v;
+
+	while (**p == ' ') {
+		(*p)++;
+	}
+	v = strtol(*p, &end, 10);
+	if (end == *p) {
+		return -1;
+	}
+	*p = end;
+	return v;
+}
+
+/** @brief Versao nova publicada: acordar a maquina de estados para a usar */
+static void loader_published(void)
+{
+	event_ring_push(loader_ring, NONE);
+	k_sem_give(loader_wake);
+}
+
+/** @brief Fim do carregamento com erro */
+static void loader_fail(const char *what, int err)
+{
+	catalog_stage_abort();
+	loading = false;
+	vm_printf("Catalogo rejeitado: %s (%d), %u bytes recusados na rececao\n", what, err,
+		  rx_refused);
+}
+
+/** @brief Interpreta uma linha completa */
+static void loader_line(const char *l)
+{
+	const char *p;
+	long count, hour, price;
+	int ret;
+
+#ifdef CONFIG_VENDING_WALLCLOCK
+	if (strncmp(l, "TIME ", 5) == 0 && !loading) {
+		/* acerto da hora: TIME hh:mm */
+		long minute = -1;
+
+		p = l + 5;
+		hour = parse_num(&p);
+		if (*p == ':') {
+			p++;
+			minute = parse_num(&p);
+		}
+		if (hour >= 0 && hour < 24 && minute >= 0 && minute < 60) {
+			wallclock_set(hour * 60 + minute);
+		}
+		return;
+	}
+#endif
+#ifdef CONFIG_VENDING_RECORDER
+	if (strcmp(l, "DUMP") == 0 && !loading) {
+		/* imprimir o gravador de eventos (scripts/rec_extract.py) */
+		recorder_dump();
+		return;
+	}
+#endif
+	if (strncmp(l, "CAT ", 4) == 0) {
+		if (loading) {
+			catalog_stage_abort();
+		}
+		p = l + 4;
+		count = parse_num(&p);
+		ret = catalog_stage_begin(count > 0 && count <= UINT16_MAX ? (uint16_t)count : 0);
+		if (ret < 0) {
+			loader_fail("CAT", ret);
+			return;
+		}
+		loading = true;
+	} else if (!loading) {
+		/* texto fora de um catalogo (ex.: eco do terminal) */
+		return;
+	} else if (strcmp(l, "END") == 0) {
+		loading = false;
+		ret = catalog_stage_publish(0);
+		if (ret < 0) {
+			loader_fail("END", ret);
+			return;
+		}
+		loader_published();
+	} else {
+		p = l;
+		hour = parse_num(&p);
+		price = parse_num(&p);
+		while (*p == ' ') {
+			p++;
+		}
+		/* Validar o registo antes de guardar o titulo: as strings do pool nunca sao
+		 * libertadas, um registo rejeitado depois do intern gastava espaço */
+		if (hour < 0 || hour > UINT8_MAX || price < 0 || price > UINT8_MAX || *p == '\0') {
+			ret = -EINVAL;
+		} else {
+			ret = catalog_stage_check((uint8_t)hour, (uint8_t)price);
+		}
+		if (ret == 0) {
+			/* o resto da linha é o titulo (varias sessoes do mesmo filme partilham a string) */
+			ret = strpool_intern(p, strlen(p));
+		}
+		if (ret >= 0) {
+			ret = catalog_stage_add(ret, (uint8_t)hour, (uint8_t)price);
+		}
+		if (ret < 0) {
+			loader_fail(l, ret);
+		}
+	}
+}
+
+static void loader_work_fn(struct k_work *work)
+{
+	k_spinlock_key_t key;
+	uint8_t buf[32];
+	uint32_t n, i;
+	int ret __unused;
+
+	do {
+		key = k_spin_lock(&loader_lock);
+		n = ring_buf_get(&loader_rx, buf, sizeof(buf));
+		k_spin_unlock(&loader_lock, key);
+
+		for (i = 0; i < n; i++) {
+#ifdef CONFIG_VENDING_CATALOG_DELTA
+			/* Atualizaçao incremental: binaria, começa pela marca no inicio de uma linha */
+			if (catalog_delta_active() ||
+			    (line_len == 0 && buf[i] == CATALOG_DELTA_MAGIC)) {
+				ret = catalog_delta_byte(buf[i]);
+				if (ret > 0) {
+					loader_published();
+				} else if (ret < 0) {
+					vm_printf("Atualizacao rejeitada (%d)\n", ret);
+				}
+				continue;
+			}
+#endif
+			if (buf[i] == '\r' || buf[i] == '\n') {
+				line[line_len] = '\0';
+				if (line_len > 0 && !line_overflow) {
+					loader_line(line);
+				}
+				line_len = 0;
+				line_overflow = false;
+			} else if (line_len < LOADER_LINE_MAX - 1) {
+				line[line_len++] = (char)buf[i];
+			} else {
+				line_overflow = true;
+			}
+		}
+	} while (n > 0);
+}
+
+size_t catalog_loader_feed(const uint8_t *data, size_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&loader_lock);
+	uint32_t n = ring_buf_put(&loader_rx, data, len);
+
+	rx_refused += len - n;
+	k_spin_unlock(&loader_lock, key);
+	k_work_submit_to_queue(&loader_q, &loader_work);
+	return n;
+}
+
+int catalog_loader_init(struct event_ring *ring, struct k_sem *wake)
+{
+	loader_ring = ring;
+	loader_wake = wake;
+	k_work_queue_start(&loader_q, loader_stack, K_THREAD_STACK_SIZEOF(loader_stack),
+			   CONFIG_VENDING_CATALOG_LOADER_PRIORITY,
+			   &(const struct k_work_queue_config){ .name = "catalog_loader" });
+#ifdef CONFIG_VENDING_ASYNC_OUTPUT
+	/* Receçao pela mesma UART da saida */
+	return output_rx_enable(catalog_loader_feed);
+#else
+	return 0;
+#endif
+}
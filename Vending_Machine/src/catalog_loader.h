@@ -0,0 +1,57 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file catalog_loader.h
+* \brief Carregamento de um catalogo novo em tempo de execuçao
+*
+* Recebe o catalogo como texto, uma linha por registo:
+*
+*     CAT <sessoes>
+*     <hora> <preço> <titulo>     (uma linha por sessao, ex.: "19 9 Noites de Maio")
+*     END
+*
+* Com CONFIG_VENDING_CATALOG_DELTA aceita tambem atualizaçoes incrementais binarias
+* (catalog_delta.h), que começam por um byte que nao aparece no texto.
+*
+* Os bytes chegam pela UART (RX assincrono) ou, em native_posix, de um ficheiro do host
+* (opçao -catalog=<ficheiro>). Sao interpretados numa work queue, fora da maquina de estados,
+* e a versao nova é publicada com catalog_stage_publish().
+*/
+
+#ifndef CATALOG_LOADER_H_
+#define CATALOG_LOADER_H_
+
+#include <zephyr.h>
+
+#include "event_ring.h"
+
+#ifdef CONFIG_VENDING_CATALOG_LOADER
+
+/** @brief Ativa a receçao do catalogo
+ * depois de cada publicaçao é colocado um evento NONE na fila e dado o semaforo, para a
+ * maquina de estados passar à versao nova mesmo sem botoes premidos */
+int catalog_loader_init(struct event_ring *ring, struct k_sem *wake);
+
+/** @brief Entrega bytes ao carregador (pode ser chamada de uma ISR)
+ * @return bytes aceites (os restantes sao contados como recusados; quem puder deve reenvia-los) */
+size_t catalog_loader_feed(const uint8_t *data, size_t len);
+
+#else
+
+static inline int catalog_loader_init(struct event_ring *ring, struct k_sem *wake)
+{
+	return 0;
+}
+
+#endif /* CONFIG_VENDING_CATALOG_LOADER */
+
+#ifdef CONFIG_VENDING_CATALOG_FILE
+/** @brief Chamada por main() com a thread vm_fsm iniciada: so entao o ficheiro do
+ * catalogo (-catalog=<ficheiro>) é lido */
+void catalog_file_ready(void);
+#else
+static inline void catalog_file_ready(void) { }
+#endif
+
+#endif /* CATALOG_LOADER_H_ */
@@ -0,0 +1,239 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file change.c
+* \brief Troco com stock limitado por programaçao dinamica (ver change.h)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr.h>
+
+#include "change.h"
+#include "trace.h"
+
+/** @brief Marca de quantia impossivel na tabela */
+#define CHANGE_INF 0xFF
+
+const uint8_t change_coin_value[CHANGE_NUM_COINS] = { 10, 5, 2, 1 };
+
+/** @brief Stock de cada tipo de moeda */
+static uint16_t stock[CHANGE_NUM_COINS];
+
+/** @brief dp[i][a]: menor numero de moedas para pagar a usando apenas as primeiras i moedas
+ * (com o stock atual); dp[0] so tem a quantia 0. Valores >= CHANGE_INF sao impossiveis. */
+static uint8_t dp[CHANGE_NUM_COINS + 1][CHANGE_MAX + 1];
+
+#if CONFIG_VENDING_LANES > 1
+/** @brief Stock e tabela de rascunho de change_can_pay_all() (o stock real nao muda) */
+static uint16_t stock_tmp[CHANGE_NUM_COINS];
+static uint8_t dp_tmp[CHANGE_NUM_COINS + 1][CHANGE_MAX + 1];
+#endif
+
+/** @brief Primeira linha desatualizada (CHANGE_NUM_COINS = tabela atualizada) */
+static uint8_t dirty_from;
+
+static struct change_stats stats;
+
+/** @brief Contador usado para medir o recalculo (o do trace quando ativo, mais fino) */
+static inline uint32_t change_now(void)
+{
+#ifdef CONFIG_VENDING_TRACE
+	return trace_now();
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+/** @brief Recalcula a linha i+1 da tabela t a partir da linha i (moeda i com o stock st) */
+static void change_row(uint8_t t[][CHANGE_MAX + 1], const uint16_t *st, int i)
+{
+	const uint8_t *prev = t[i];
+	uint8_t *row = t[i + 1];
+	uint8_t d = change_coin_value[i];
+	uint16_t k, kmax;
+	uint16_t a;
+	uint8_t best, v;
+
+	for (a = 0; a <= CHANGE_MAX; a++) {
+		best = prev[a];
+		kmax = MIN(st[i], a / d);
+		for (k = 1; k <= kmax; k++) {
+			v = prev[a - k * d];
+			if (v != CHANGE_INF && v + k < best) {
+				best = v + k;
+			}
+		}
+		row[a] = best;
+	}
+}
+
+/** @brief Atualiza as linhas desatualizadas da tabela */
+static void change_refresh(void)
+{
+	uint32_t t0;
+	uint32_t cycles;
+	int i;
+
+	if (dirty_from >= CHANGE_NUM_COINS) {
+		return;
+	}
+	t0 = change_now();
+	for (i = dirty_from; i < CHANGE_NUM_COINS; i++) {
+		change_row(dp, stock, i);
+	}
+	dirty_from = CHANGE_NUM_COINS;
+	cycles = change_now() - t0;
+
+	stats.refreshes++;
+	stats.refresh_max = MAX(stats.refresh_max, cycles);
+}
+
+/** @brief O stock da moeda i mudou: as linhas seguintes deixam de ser validas */
+static void change_invalidate(int i)
+{
+	dirty_from = MIN(dirty_from, (uint8_t)i);
+}
+
+void change_init(void)
+{
+	static const uint16_t initial[CHANGE_NUM_COINS] = {
+		CONFIG_VENDING_CHANGE_INIT_10, CONFIG_VENDING_CHANGE_INIT_5,
+		CONFIG_VENDING_CHANGE_INIT_2, CONFIG_VENDING_CHANGE_INIT_1,
+	};
+
+	memcpy(stock, initial, sizeof(stock));
+	memset(dp[0], CHANGE_INF, sizeof(dp[0]));
+	dp[0][0] = 0;
+#if CONFIG_VENDING_LANES > 1
+	memcpy(dp_tmp[0], dp[0], sizeof(dp[0]));
+#endif
+	dirty_from = 0;
+	change_refresh();
+
+	/* Pior caso: todas as linhas recalculadas */
+	stats.refresh_full = stats.refresh_max;
+	stats.refresh_max = 0;
+	stats.refreshes = 0;
+}
+
+void change_deposit(uint8_t value)
+{
+	int i;
+
+	for (i = 0; i < CHANGE_NUM_COINS; i++) {
+		if (change_coin_value[i] == value) {
+			stock[i]++;
+			change_invalidate(i);
+			return;
+		}
+	}
+}
+
+bool change_can_pay(int amount)
+{
+	if (amount < 0 || amount > CHANGE_MAX) {
+		return false;
+	}
+	change_refresh();
+	return dp[CHANGE_NUM_COINS][amount] != CHANGE_INF;
+}
+
+/** @brief Reconstroi o pagamento de amount (possivel) a partir da tabela t do stock st */
+static int change_plan_from(uint8_t t[][CHANGE_MAX + 1], const uint16_t *st, int amount,
+			    uint8_t out[CHANGE_NUM_COINS])
+{
+	int total = t[CHANGE_NUM_COINS][amount];
+	uint16_t k, kmax;
+	uint8_t d;
+	int i;
+
+	/* Reconstruçao a partir da ultima moeda: escolher k tal que t[i][a - k*d] + k == t[i+1][a] */
+	for (i = CHANGE_NUM_COINS - 1; i >= 0; i--) {
+		d = change_coin_value[i];
+		kmax = MIN(st[i], amount / d);
+		for (k = 0; k <= kmax; k++) {
+			if (t[i][amount - k * d] != CHANGE_INF &&
+			    t[i][amount - k * d] + k == t[i + 1][amount]) {
+				break;
+			}
+		}
+		out[i] = (uint8_t)k;
+		amount -= k * d;
+	}
+	return total;
+}
+
+int change_plan(int amount, uint8_t out[CHANGE_NUM_COINS])
+{
+	if (!change_can_pay(amount)) {
+		return -ENOENT;
+	}
+	return change_plan_from(dp, stock, amount, out);
+}
+
+#if CONFIG_VENDING_LANES > 1
+bool change_can_pay_all(const int *amount, int n)
+{
+	uint8_t out[CHANGE_NUM_COINS];
+	int a, i;
+
+	/* A primeira quantia usa a tabela do stock real */
+	if (!change_can_pay(amount[0])) {
+		return false;
+	}
+	change_plan_from(dp, stock, amount[0], out);
+	for (i = 0; i < CHANGE_NUM_COINS; i++) {
+		stock_tmp[i] = stock[i] - out[i];
+	}
+	for (a = 1; a < n; a++) {
+		if (amount[a] == 0) {
+			continue;
+		}
+		if (amount[a] < 0 || amount[a] > CHANGE_MAX) {
+			return false;
+		}
+		for (i = 0; i < CHANGE_NUM_COINS; i++) {
+			change_row(dp_tmp, stock_tmp, i);
+		}
+		if (dp_tmp[CHANGE_NUM_COINS][amount[a]] == CHANGE_INF) {
+			return false;
+		}
+		change_plan_from(dp_tmp, stock_tmp, amount[a], out);
+		for (i = 0; i < CHANGE_NUM_COINS; i++) {
+			stock_tmp[i] -= out[i];
+		}
+	}
+	return true;
+}
+#endif
+
+int change_payout(int amount, uint8_t out[CHANGE_NUM_COINS])
+{
+	int total = change_plan(amount, out);
+	int i;
+
+	if (total < 0) {
+		return total;
+	}
+	for (i = 0; i < CHANGE_NUM_COINS; i++) {
+		if (out[i]) {
+			stock[i] -= out[i];
+			change_invalidate(i);
+		}
+	}
+	stats.payouts++;
+	return total;
+}
+
+void change_refused(void)
+{
+	stats.refused++;
+}
+
+void change_stats_get(struct change_stats *st, uint16_t st_stock[CHANGE_NUM_COINS])
+{
+	*st = stats;
+	memcpy(st_stock, stock, sizeof(stock));
+}
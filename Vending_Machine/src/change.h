@@ -0,0 +1,71 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file change.h
+* \brief Troco: inventario de moedas e pagamento com o menor numero de moedas
+*
+* Mantem o numero de moedas de 10, 5, 2 e 1 EUR nos tubos e uma tabela de programaçao
+* dinamica com o numero minimo de moedas para pagar cada quantia ate
+* CONFIG_VENDING_CHANGE_MAX com o stock atual. A tabela tem uma linha por moeda e, quando
+* o stock de uma moeda muda, so as linhas a partir dessa moeda sao recalculadas (na
+* consulta seguinte). Verificar se uma quantia tem troco é O(1).
+*/
+
+#ifndef CHANGE_H_
+#define CHANGE_H_
+
+#include <zephyr.h>
+
+/** @brief Numero de tipos de moeda (10, 5, 2, 1 EUR) */
+#define CHANGE_NUM_COINS 4
+
+/** @brief Quantia maxima que a tabela consegue pagar */
+#define CHANGE_MAX CONFIG_VENDING_CHANGE_MAX
+
+/** @brief Valor (EUR) de cada tipo de moeda, pela ordem usada em todas as funçoes */
+extern const uint8_t change_coin_value[CHANGE_NUM_COINS];
+
+/** @brief Estatisticas do calculo do troco
+ * os tempos estao em ciclos de trace_now() (ou de k_cycle_get_32 sem CONFIG_VENDING_TRACE) */
+struct change_stats {
+	uint32_t refreshes;	/**< recalculos da tabela */
+	uint32_t refresh_full;	/**< recalculo da tabela inteira (no arranque) */
+	uint32_t refresh_max;	/**< pior recalculo durante o funcionamento */
+	uint32_t payouts;	/**< pagamentos efetuados */
+	uint32_t refused;	/**< vendas recusadas por falta de troco */
+};
+
+/** @brief Carrega o stock inicial dos tubos (CONFIG_VENDING_CHANGE_INIT_*)
+ * deve ser chamada depois de trace_init() para a mediçao do recalculo completo */
+void change_init(void);
+
+/** @brief Moeda de valor value inserida pelo cliente: fica disponivel para troco */
+void change_deposit(uint8_t value);
+
+/** @brief Verifica se a quantia pode ser paga exatamente com o stock atual */
+bool change_can_pay(int amount);
+
+/** @brief Verifica se as quantias podem ser todas pagas com o stock atual, pela ordem
+ * indicada e cada uma com o menor numero de moedas do stock que sobra da anterior
+ * (CONFIG_VENDING_LANES > 1: troco de um painel com o credito dos outros reservado).
+ * true garante o pagamento de todas; pode recusar um caso raro que so outra combinaçao
+ * de moedas pagaria. O stock nao é alterado */
+bool change_can_pay_all(const int *amount, int n);
+
+/** @brief Calcula o pagamento com menos moedas, sem alterar o stock
+ * @param out numero de moedas de cada tipo (change_coin_value)
+ * @return numero total de moedas, ou -ENOENT se nao houver troco exato */
+int change_plan(int amount, uint8_t out[CHANGE_NUM_COINS]);
+
+/** @brief Paga a quantia: calcula o pagamento e retira as moedas do stock
+ * @return numero total de moedas, ou -ENOENT (stock nao é alterado) */
+int change_payout(int amount, uint8_t out[CHANGE_NUM_COINS]);
+
+/** @brief Conta uma venda recusada por falta de troco */
+void change_refused(void);
+
+/** @brief Le as estatisticas e o stock atual */
+void change_stats_get(struct change_stats *st, uint16_t stock[CHANGE_NUM_COINS]);
+
+#endif /* CHANGE_H_ */
@@ -0,0 +1,96 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file event_ring.c
+* \brief Implementaçao da fila circular lock-free de eventos (ver event_ring.h)
+*/
+
+#include "event_ring.h"
+
+void event_ring_init(struct event_ring *r)
+{
+	int i;
+
+	for (i = 0; i < EVENT_RING_SIZE; i++) {
+		atomic_set(&r->cells[i].seq, i);
+	}
+	atomic_set(&r->head, 0);
+	atomic_set(&r->tail, 0);
+	atomic_set(&r->pushed, 0);
+	atomic_set(&r->overflows, 0);
+	atomic_set(&r->high_water, 0);
+}
+
+/* Atualiza a ocupaçao maxima observada */
+static void event_ring_update_high_water(struct event_ring *r, uint32_t level)
+{
+	atomic_val_t hw = atomic_get(&r->high_water);
+
+	while ((uint32_t)hw < level) {
+		if (atomic_cas(&r->high_water, hw, level)) {
+			break;
+		}
+		hw = atomic_get(&r->high_water);
+	}
+}
+
+bool event_ring_push_at(struct event_ring *r, Event ev, uint32_t t_isr)
+{
+	struct event_ring_cell *cell;
+	atomic_val_t pos = atomic_get(&r->head);
+	int32_t dif;
+
+	/* Reservar uma posiçao: so avança head quem ganhar o compare-and-swap */
+	for (;;) {
+		cell = &r->cells[pos & EVENT_RING_MASK];
+		dif = (int32_t)((uint32_t)atomic_get(&cell->seq) - (uint32_t)pos);
+		if (dif == 0) {
+			if (atomic_cas(&r->head, pos, pos + 1)) {
+				break;
+			}
+		} else if (dif < 0) {
+			/* fila cheia: o consumidor ainda nao libertou esta posiçao */
+			atomic_inc(&r->overflows);
+			return false;
+		}
+		pos = atomic_get(&r->head);
+	}
+
+	cell->evt.ts = k_cycle_get_32();
+	cell->evt.ev = ev;
+#ifdef CONFIG_VENDING_TRACE
+	cell->evt.t_isr = t_isr;
+#endif
+	/* Publicar a posiçao para o consumidor */
+	atomic_set(&cell->seq, pos + 1);
+
+	atomic_inc(&r->pushed);
+	event_ring_update_high_water(r, (uint32_t)(pos + 1 - atomic_get(&r->tail)));
+	return true;
+}
+
+bool event_ring_pop(struct event_ring *r, struct vm_event *out)
+{
+	atomic_val_t pos = atomic_get(&r->tail);
+	struct event_ring_cell *cell = &r->cells[pos & EVENT_RING_MASK];
+
+	/* Posiçao ainda nao publicada (fila vazia ou produtor a meio da escrita) */
+	if ((uint32_t)atomic_get(&cell->seq) != (uint32_t)(pos + 1)) {
+		return false;
+	}
+
+	*out = cell->evt;
+	/* Devolver a posiçao aos produtores para a proxima volta da fila */
+	atomic_set(&cell->seq, pos + EVENT_RING_SIZE);
+	atomic_set(&r->tail, pos + 1);
+	return true;
+}
+
+void event_ring_stats_get(struct event_ring *r, struct event_ring_stats *st)
+{
+	st->pushed = (uint32_t)atomic_get(&r->pushed);
+	st->overflows = (uint32_t)atomic_get(&r->overflows);
+	st->high_water = (uint32_t)atomic_get(&r->high_water);
+	st->capacity = EVENT_RING_SIZE;
+}
@@ -0,0 +1,85 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file event_ring.h
+* \brief Fila circular lock-free de eventos entre a callback dos botoes e a maquina de estados
+*
+* Fila de capacidade fixa (CONFIG_VENDING_EVENT_RING_SIZE, potencia de 2) com varios
+* produtores (ISR/threads) e um unico consumidor (a maquina de estados).
+* Cada posiçao tem um numero de sequencia, pelo que os produtores reservam a posiçao
+* com compare-and-swap e a publicam sem nunca bloquear ou desativar interrupçoes.
+* Quando a fila esta cheia o evento é descartado e contado em overflows.
+*/
+
+#ifndef EVENT_RING_H_
+#define EVENT_RING_H_
+
+#include <zephyr.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "vending.h"
+
+#define EVENT_RING_SIZE CONFIG_VENDING_EVENT_RING_SIZE
+#define EVENT_RING_MASK (EVENT_RING_SIZE - 1)
+
+BUILD_ASSERT((EVENT_RING_SIZE & EVENT_RING_MASK) == 0,
+	     "CONFIG_VENDING_EVENT_RING_SIZE must be a power of 2");
+
+/** @brief Evento com o instante (k_cycle_get_32) em que foi colocado na fila */
+struct vm_event {
+	uint32_t ts;
+	Event ev;
+#ifdef CONFIG_VENDING_TRACE
+	uint32_t t_isr;	/**< instante do flanco que originou o evento (relogio do trace) */
+#endif
+};
+
+/** @brief Posiçao da fila
+ * seq indica se a posiçao esta livre para o produtor (seq == pos) ou pronta para o consumidor (seq == pos+1) */
+struct event_ring_cell {
+	atomic_t seq;
+	struct vm_event evt;
+};
+
+/** @brief Fila de eventos e respetivas estatisticas */
+struct event_ring {
+	atomic_t head;		/**< proxima posiçao a reservar pelos produtores */
+	atomic_t tail;		/**< proxima posiçao a ler pelo consumidor */
+	atomic_t pushed;	/**< eventos aceites */
+	atomic_t overflows;	/**< eventos perdidos por a fila estar cheia */
+	atomic_t high_water;	/**< ocupaçao maxima observada */
+	struct event_ring_cell cells[EVENT_RING_SIZE];
+};
+
+/** @brief Copia das estatisticas da fila */
+struct event_ring_stats {
+	uint32_t pushed;
+	uint32_t overflows;
+	uint32_t high_water;
+	uint32_t capacity;
+};
+
+/** @brief Inicializa a fila (tem de ser chamada antes de ativar as interrupçoes) */
+void event_ring_init(struct event_ring *r);
+
+/** @brief Coloca um evento na fila. Pode ser chamada em contexto de ISR.
+ * @param t_isr instante do flanco (so guardado com CONFIG_VENDING_TRACE)
+ * @return true se o evento foi aceite, false se a fila estava cheia */
+bool event_ring_push_at(struct event_ring *r, Event ev, uint32_t t_isr);
+
+/** @brief Coloca um evento sem instante de flanco na fila (ver event_ring_push_at()) */
+static inline bool event_ring_push(struct event_ring *r, Event ev)
+{
+	return event_ring_push_at(r, ev, 0);
+}
+
+/** @brief Retira o evento mais antigo da fila. Apenas o consumidor a pode chamar.
+ * @return true se foi retirado um evento para *out */
+bool event_ring_pop(struct event_ring *r, struct vm_event *out);
+
+/** @brief Le as estatisticas da fila (overflows e high-water mark) */
+void event_ring_stats_get(struct event_ring *r, struct event_ring_stats *st);
+
+#endif /* EVENT_RING_H_ */
@@ -0,0 +1,42 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file fsm.c
+* \brief Motor generico de maquinas de estado por tabela (ver fsm.h)
+*/
+
+#include "fsm.h"
+
+void fsm_init(struct fsm *f, const struct fsm_cell *table, uint8_t n_states,
+	      uint8_t n_events, uint8_t initial)
+{
+	f->table = table;
+	f->n_states = n_states;
+	f->n_events = n_events;
+	f->state = initial;
+}
+
+bool fsm_dispatch(struct fsm *f, int ev, void *ctx)
+{
+	const struct fsm_cell *cell;
+	const struct fsm_transition *t;
+	uint8_t i;
+
+	if (ev < 0 || ev >= f->n_events) {
+		return false;
+	}
+
+	cell = &f->table[f->state * f->n_events + ev];
+	for (i = 0; i < cell->n; i++) {
+		t = &cell->t[i];
+		if (t->guard == NULL || t->guard(ctx, ev)) {
+			if (t->action != NULL) {
+				t->action(ctx, ev);
+			}
+			f->state = t->next;
+			return true;
+		}
+	}
+	return false;
+}
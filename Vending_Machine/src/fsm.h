@@ -0,0 +1,57 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file fsm.h
+* \brief Motor generico de maquinas de estado por tabela (estado x evento)
+*
+* A tabela é const (fica em flash) e tem uma celula por par (estado, evento). Cada celula
+* tem uma lista curta de transiçoes: a primeira cuja guarda é verdadeira (ou sem guarda)
+* executa a sua açao e define o estado seguinte. O custo de despacho nao depende do numero
+* de estados nem de eventos.
+*/
+
+#ifndef FSM_H_
+#define FSM_H_
+
+#include <zephyr.h>
+
+/** @brief Transiçao: guarda opcional, açao opcional e estado seguinte */
+struct fsm_transition {
+	bool (*guard)(void *ctx, int ev);	/**< NULL = transiçao sempre valida */
+	void (*action)(void *ctx, int ev);	/**< NULL = sem açao */
+	uint8_t next;				/**< estado seguinte */
+};
+
+/** @brief Celula da tabela: transiçoes candidatas para um par (estado, evento) */
+struct fsm_cell {
+	const struct fsm_transition *t;
+	uint8_t n;
+};
+
+/** @brief Instancia de uma maquina de estados */
+struct fsm {
+	const struct fsm_cell *table;	/**< tabela [n_states][n_events] */
+	uint8_t n_states;
+	uint8_t n_events;
+	uint8_t state;			/**< estado atual */
+};
+
+/** @brief Define uma celula a partir de uma lista de transiçoes {guarda, açao, seguinte} */
+#define FSM_CELL(...) { \
+	.t = (const struct fsm_transition[]){ __VA_ARGS__ }, \
+	.n = sizeof((const struct fsm_transition[]){ __VA_ARGS__ }) / sizeof(struct fsm_transition), \
+}
+
+/** @brief Celula vazia: o evento é ignorado nesse estado */
+#define FSM_IGNORE { .t = NULL, .n = 0 }
+
+/** @brief Inicializa a maquina de estados com a tabela e o estado inicial */
+void fsm_init(struct fsm *f, const struct fsm_cell *table, uint8_t n_states,
+	      uint8_t n_events, uint8_t initial);
+
+/** @brief Despacha um evento: executa a primeira transiçao valida e muda de estado
+ * @return true se alguma transiçao foi executada */
+bool fsm_dispatch(struct fsm *f, int ev, void *ctx);
+
+#endif /* FSM_H_ */
@@ -0,0 +1,417 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file fsm_bench.c
+* \brief Micro-benchmark do custo de despacho: tabela (fsm.c) e SMF hierarquico contra o switch original
+*
+* As tres versoes implementam as mesmas transiçoes de MENU/MOVIES/UPDATE_CREDIT, mas as
+* açoes apenas atualizam contadores (sem printk), para medir so o custo de decisao.
+*/
+
+#include <zephyr.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/smf.h>
+
+#include "vending.h"
+#include "fsm.h"
+
+#define BENCH_EVENTS CONFIG_VENDING_FSM_BENCH_EVENTS
+#define BENCH_MOVIES 5
+#define BENCH_PRICE 9
+
+/** @brief Sequencia de eventos usada pelas duas versoes */
+static uint8_t bench_events[BENCH_EVENTS];
+
+/** @brief Estado das tres versoes (devem terminar iguais)
+ * smf tem de ser o primeiro membro (SMF_CTX); as outras versoes nao o usam */
+struct bench_ctx {
+	struct smf_ctx smf;
+	int ev;
+	int credit;
+	int idx;
+	int same_movie;
+	uint32_t tickets;
+	uint32_t prints;
+};
+
+static const uint8_t bench_coin[NUM_EVENTS] = { [ADD1] = 1, [ADD2] = 2, [ADD5] = 5, [ADD10] = 10 };
+
+//---------------------------------------------------------
+/* Versao switch: copia da logica original de main(), incluindo as passagens extra pelo
+ * switch quando o evento fica pendente para o estado seguinte */
+static void bench_switch(struct bench_ctx *c, States *estado, Event ev)
+{
+	Event eventos = ev;
+
+	while (eventos != NONE) {
+		switch (*estado) {
+		case MENU:
+			if (eventos == ADD1 || eventos == ADD2 || eventos == ADD5 || eventos == ADD10) {
+				*estado = UPDATE_CREDIT;
+			} else if (eventos == RET) {
+				c->prints++;
+				c->credit = 0;
+				eventos = NONE;
+			} else if (eventos == UP || eventos == DOWN) {
+				*estado = MOVIES;
+				c->same_movie = 1;
+			} else if (eventos == SEL) {
+				eventos = NONE;
+			}
+			break;
+
+		case UPDATE_CREDIT:
+			if (eventos == RET) {
+				c->prints++;
+				c->credit = 0;
+				eventos = NONE;
+				*estado = MENU;
+				break;
+			}
+			if (eventos == UP || eventos == DOWN) {
+				c->same_movie = 1;
+				*estado = MOVIES;
+				break;
+			}
+			if (eventos == SEL && c->same_movie == 1) {
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == SEL && c->same_movie == 0 && c->credit < BENCH_PRICE) {
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == SEL && c->same_movie == 0 && c->credit >= BENCH_PRICE) {
+				c->credit -= BENCH_PRICE;
+				c->tickets++;
+				c->same_movie = 1;
+				*estado = MENU;
+				eventos = NONE;
+				break;
+			}
+			if (eventos == ADD1) {
+				c->credit += 1;
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == ADD2) {
+				c->credit += 2;
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == ADD5) {
+				c->credit += 5;
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == ADD10) {
+				c->credit += 10;
+				c->prints++;
+				eventos = NONE;
+			}
+			break;
+
+		case MOVIES:
+			if (eventos == ADD1 || eventos == ADD2 || eventos == ADD5 || eventos == ADD10) {
+				*estado = UPDATE_CREDIT;
+				break;
+			}
+			if (eventos == RET) {
+				c->prints++;
+				c->credit = 0;
+				eventos = NONE;
+				*estado = MENU;
+				break;
+			}
+			if (eventos == SEL && c->credit < BENCH_PRICE) {
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == SEL && c->credit >= BENCH_PRICE) {
+				c->credit -= BENCH_PRICE;
+				c->tickets++;
+				*estado = MENU;
+				eventos = NONE;
+				c->same_movie = 1;
+				break;
+			}
+			if (c->same_movie == 1) {
+				c->prints++;
+				eventos = NONE;
+				c->same_movie = 0;
+			} else if (eventos == UP) {
+				c->idx = (c->idx + 1) % BENCH_MOVIES;
+				c->prints++;
+				eventos = NONE;
+			} else if (eventos == DOWN) {
+				c->idx = c->idx - 1;
+				if (c->idx < 0) {
+					c->idx = BENCH_MOVIES - 1;
+				}
+				c->prints++;
+				eventos = NONE;
+			}
+			break;
+
+		default:
+			eventos = NONE;
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------------
+/* Versao tabela: mesmas transiçoes que vm_table em main.c */
+static bool b_no_movie(void *ctx, int ev)
+{
+	return ((struct bench_ctx *)ctx)->same_movie == 1;
+}
+
+static bool b_no_credit(void *ctx, int ev)
+{
+	return ((struct bench_ctx *)ctx)->credit < BENCH_PRICE;
+}
+
+static void b_add(void *ctx, int ev)
+{
+	struct bench_ctx *c = ctx;
+
+	c->credit += bench_coin[ev];
+	c->prints++;
+}
+
+static void b_return(void *ctx, int ev)
+{
+	struct bench_ctx *c = ctx;
+
+	c->credit = 0;
+	c->prints++;
+}
+
+static void b_show(void *ctx, int ev)
+{
+	struct bench_ctx *c = ctx;
+
+	c->prints++;
+	c->same_movie = 0;
+}
+
+static void b_next(void *ctx, int ev)
+{
+	struct bench_ctx *c = ctx;
+
+	c->idx = (c->idx + 1) % BENCH_MOVIES;
+	c->prints++;
+}
+
+static void b_prev(void *ctx, int ev)
+{
+	struct bench_ctx *c = ctx;
+
+	c->idx = c->idx - 1;
+	if (c->idx < 0) {
+		c->idx = BENCH_MOVIES - 1;
+	}
+	c->prints++;
+}
+
+static void b_warn(void *ctx, int ev)
+{
+	((struct bench_ctx *)ctx)->prints++;
+}
+
+static void b_ticket(void *ctx, int ev)
+{
+	struct bench_ctx *c = ctx;
+
+	c->credit -= BENCH_PRICE;
+	c->tickets++;
+	c->same_movie = 1;
+}
+
+#define B_ADD		FSM_CELL({ NULL, b_add, UPDATE_CREDIT })
+#define B_RETURN	FSM_CELL({ NULL, b_return, MENU })
+#define B_SHOW		FSM_CELL({ NULL, b_show, MOVIES })
+
+static const struct fsm_cell bench_table[NUM_STATES * NUM_EVENTS] = {
+	[MENU * NUM_EVENTS + NONE]	= FSM_IGNORE,
+	[MENU * NUM_EVENTS + ADD1]	= B_ADD,
+	[MENU * NUM_EVENTS + ADD2]	= B_ADD,
+	[MENU * NUM_EVENTS + ADD5]	= B_ADD,
+	[MENU * NUM_EVENTS + ADD10]	= B_ADD,
+	[MENU * NUM_EVENTS + UP]	= B_SHOW,
+	[MENU * NUM_EVENTS + DOWN]	= B_SHOW,
+	[MENU * NUM_EVENTS + SEL]	= FSM_IGNORE,
+	[MENU * NUM_EVENTS + RET]	= B_RETURN,
+
+	[MOVIES * NUM_EVENTS + NONE]	= FSM_IGNORE,
+	[MOVIES * NUM_EVENTS + ADD1]	= B_ADD,
+	[MOVIES * NUM_EVENTS + ADD2]	= B_ADD,
+	[MOVIES * NUM_EVENTS + ADD5]	= B_ADD,
+	[MOVIES * NUM_EVENTS + ADD10]	= B_ADD,
+	[MOVIES * NUM_EVENTS + UP]	= FSM_CELL({ NULL, b_next, MOVIES }),
+	[MOVIES * NUM_EVENTS + DOWN]	= FSM_CELL({ NULL, b_prev, MOVIES }),
+	[MOVIES * NUM_EVENTS + SEL]	= FSM_CELL({ b_no_credit, b_warn, MOVIES },
+						   { NULL, b_ticket, MENU }),
+	[MOVIES * NUM_EVENTS + RET]	= B_RETURN,
+
+	[UPDATE_CREDIT * NUM_EVENTS + NONE]	= FSM_IGNORE,
+	[UPDATE_CREDIT * NUM_EVENTS + ADD1]	= B_ADD,
+	[UPDATE_CREDIT * NUM_EVENTS + ADD2]	= B_ADD,
+	[UPDATE_CREDIT * NUM_EVENTS + ADD5]	= B_ADD,
+	[UPDATE_CREDIT * NUM_EVENTS + ADD10]	= B_ADD,
+	[UPDATE_CREDIT * NUM_EVENTS + UP]	= B_SHOW,
+	[UPDATE_CREDIT * NUM_EVENTS + DOWN]	= B_SHOW,
+	[UPDATE_CREDIT * NUM_EVENTS + SEL]	= FSM_CELL({ b_no_movie, b_warn, UPDATE_CREDIT },
+							   { b_no_credit, b_warn, UPDATE_CREDIT },
+							   { NULL, b_ticket, MENU }),
+	[UPDATE_CREDIT * NUM_EVENTS + RET]	= B_RETURN,
+};
+
+//---------------------------------------------------------
+/* Versao SMF: mesmos estados filhos de um pai que trata moedas e RET (como main.c) */
+static const struct smf_state bench_states[NUM_STATES];
+
+static void b_goto(struct bench_ctx *c, States s)
+{
+	if (c->smf.current != &bench_states[s]) {
+		smf_set_state(SMF_CTX(c), &bench_states[s]);
+	}
+}
+
+static void bs_session(void *obj)
+{
+	struct bench_ctx *c = obj;
+
+	if (c->ev == RET) {
+		b_return(c, c->ev);
+		b_goto(c, MENU);
+	} else if (c->ev >= ADD1 && c->ev <= ADD10) {
+		b_add(c, c->ev);
+		b_goto(c, UPDATE_CREDIT);
+	}
+}
+
+static void bs_sell(struct bench_ctx *c)
+{
+	if (b_no_credit(c, c->ev)) {
+		b_warn(c, c->ev);
+	} else {
+		b_ticket(c, c->ev);
+		b_goto(c, MENU);
+	}
+}
+
+static void bs_menu(void *obj)
+{
+	struct bench_ctx *c = obj;
+
+	if (c->ev == UP || c->ev == DOWN) {
+		b_goto(c, MOVIES);
+	}
+}
+
+static void bs_movies_entry(void *obj)
+{
+	b_show(obj, 0);
+}
+
+static void bs_movies(void *obj)
+{
+	struct bench_ctx *c = obj;
+
+	if (c->ev == UP) {
+		b_next(c, c->ev);
+	} else if (c->ev == DOWN) {
+		b_prev(c, c->ev);
+	} else if (c->ev == SEL) {
+		bs_sell(c);
+	}
+}
+
+static void bs_credit(void *obj)
+{
+	struct bench_ctx *c = obj;
+
+	if (c->ev == UP || c->ev == DOWN) {
+		b_goto(c, MOVIES);
+	} else if (c->ev == SEL) {
+		if (b_no_movie(c, c->ev)) {
+			b_warn(c, c->ev);
+		} else {
+			bs_sell(c);
+		}
+	}
+}
+
+static const struct smf_state bench_session = SMF_CREATE_STATE(NULL, bs_session, NULL, NULL);
+
+static const struct smf_state bench_states[NUM_STATES] = {
+	[MENU]		= SMF_CREATE_STATE(NULL, bs_menu, NULL, &bench_session),
+	[MOVIES]	= SMF_CREATE_STATE(bs_movies_entry, bs_movies, NULL, &bench_session),
+	[UPDATE_CREDIT]	= SMF_CREATE_STATE(NULL, bs_credit, NULL, &bench_session),
+};
+
+/** @brief Gera a sequencia de eventos (xorshift32 com semente fixa, reprodutivel) */
+static void bench_fill(void)
+{
+	uint32_t x = 0x2545F491;
+	int i;
+
+	for (i = 0; i < BENCH_EVENTS; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		bench_events[i] = 1 + (x % (NUM_EVENTS - 1));
+	}
+}
+
+void fsm_bench_run(void)
+{
+	struct bench_ctx sw = { .same_movie = 1 };
+	struct bench_ctx tb = { .same_movie = 1 };
+	struct bench_ctx sm = { .same_movie = 1 };
+	States estado = MENU;
+	struct fsm f;
+	timing_t t0, t1;
+	uint64_t sw_cycles, tb_cycles, sm_cycles;
+	int i;
+
+	bench_fill();
+	fsm_init(&f, bench_table, NUM_STATES, NUM_EVENTS, MENU);
+	timing_init();
+	timing_start();
+
+	t0 = timing_counter_get();
+	for (i = 0; i < BENCH_EVENTS; i++) {
+		bench_switch(&sw, &estado, (Event)bench_events[i]);
+	}
+	t1 = timing_counter_get();
+	sw_cycles = timing_cycles_get(&t0, &t1);
+
+	t0 = timing_counter_get();
+	for (i = 0; i < BENCH_EVENTS; i++) {
+		fsm_dispatch(&f, bench_events[i], &tb);
+	}
+	t1 = timing_counter_get();
+	tb_cycles = timing_cycles_get(&t0, &t1);
+
+	smf_set_initial(SMF_CTX(&sm), &bench_states[MENU]);
+	t0 = timing_counter_get();
+	for (i = 0; i < BENCH_EVENTS; i++) {
+		sm.ev = bench_events[i];
+		smf_run_state(SMF_CTX(&sm));
+	}
+	t1 = timing_counter_get();
+	sm_cycles = timing_cycles_get(&t0, &t1);
+
+	printk("FSM bench (%d eventos): switch %u, tabela %u, SMF %u ciclos/evento\n",
+	       BENCH_EVENTS, (uint32_t)(sw_cycles / BENCH_EVENTS), (uint32_t)(tb_cycles / BENCH_EVENTS),
+	       (uint32_t)(sm_cycles / BENCH_EVENTS));
+	if (sw.credit != tb.credit || sw.tickets != tb.tickets || sw.prints != tb.prints ||
+	    estado != f.state) {
+		printk("FSM bench: resultados diferentes (switch %d/%u, tabela %d/%u)\n",
+		       sw.credit, sw.tickets, tb.credit, tb.tickets);
+	}
+	if (sm.credit != tb.credit || sm.tickets != tb.tickets || sm.prints != tb.prints ||
+	    sm.smf.current != &bench_states[f.state]) {
+		printk("FSM bench: resultados diferentes (SMF %d/%u, tabela %d/%u)\n",
+		       sm.credit, sm.tickets, tb.credit, tb.tickets);
+	}
+}
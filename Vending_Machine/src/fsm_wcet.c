@@ -0,0 +1,357 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file fsm_wcet.c
+* \brief Pior tempo de execuçao (WCET) medido de cada transiçao da maquina de estados
+*
+* Percorre todos os pares (estado, evento) de MENU/MOVIES/UPDATE_CREDIT e, para os eventos
+* com guardas, cada caminho (moeda devolvida, sessao começada, esgotada, sem credito, sem
+* troco, bilhete emitido). Cada caso corre CONFIG_VENDING_WCET_RUNS vezes no painel 0 com
+* as açoes reais (saida, troco, lugares, registo no diario, que é desviado e nunca chega à
+* flash) e com as interrupçoes bloqueadas, em ate
+* tres variantes: cache de instruçoes quente, cache invalidada antes de cada execuçao e
+* cache desligada (cada instruçao paga os wait states da flash; so no nRF52).
+*
+* O resultado é uma tabela CSV (linhas "WCET,...") e uma linha "WCET RESULT PASS|FAIL";
+* falha se algum caso ultrapassar o seu orçamento ou se faltar algum par (estado, evento).
+* Os casos que o catalogo nao permite preparar (N/A) nao cobrem o seu par e sao contados
+* na linha do resultado. No native_posix o contador de ciclos nao mede o tempo do alvo:
+* percorrem-se os mesmos casos mas o resultado é "WCET RESULT COVERAGE|FAIL", que so
+* verifica a cobertura.
+*/
+
+#include <zephyr.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/timing/timing.h>
+
+#if defined(CONFIG_SOC_SERIES_NRF52X)
+#include <hal/nrf_nvmc.h>
+#endif
+#ifdef CONFIG_BOARD_NATIVE_POSIX
+#include <posix_board_if.h>
+#endif
+
+#include "vending.h"
+#include "catalog.h"
+#include "seats.h"
+#include "change.h"
+#include "output.h"
+#include "journal.h"
+
+#define WCET_RUNS CONFIG_VENDING_WCET_RUNS
+/** @brief Espera maxima pelo envio da saida da execuçao anterior (ms) */
+#define WCET_FLUSH_MS 200
+
+#if defined(NVMC_FEATURE_CACHE_PRESENT)
+#define WCET_HAS_ICACHE 1
+#endif
+
+/** @brief Tempos representativos do alvo (no native_posix so se verifica a cobertura) */
+#ifndef CONFIG_BOARD_NATIVE_POSIX
+#define WCET_TIMED 1
+#endif
+
+/** @brief Resultado de um caso numa variante */
+enum wcet_result {
+	WCET_PASS,	/**< pior tempo dentro do orçamento */
+	WCET_OVER,	/**< pior tempo acima do orçamento */
+	WCET_NA,	/**< caso impossivel de preparar com este catalogo */
+};
+
+/** @brief Preparaçao do contexto antes do evento */
+enum wcet_setup {
+	W_BASE,		/**< contexto tipico do estado (ver wcet_prepare()) */
+	W_CREDIT_FULL,	/**< credito no maximo: a moeda é devolvida */
+	W_CREDIT,	/**< credito a devolver com varias moedas */
+	W_NO_MOVIE,	/**< SEL sem filme apresentado */
+	W_STARTED,	/**< SEL numa sessao que ja começou */
+	W_SOLD_OUT,	/**< SEL numa sessao esgotada */
+	W_NO_CREDIT,	/**< SEL sem credito suficiente */
+	W_NO_CHANGE,	/**< SEL sem troco para o credito restante */
+	W_TICKET,	/**< SEL que emite o bilhete */
+};
+
+/** @brief Caso medido: estado inicial, evento e caminho pelas guardas */
+struct wcet_case {
+	States state;
+	Event ev;
+	enum wcet_setup setup;
+	const char *path;
+};
+
+#define WCET_COINS(s)							\
+	{ s, ADD1, W_BASE, "credito" },					\
+	{ s, ADD2, W_BASE, "credito" },					\
+	{ s, ADD5, W_BASE, "credito" },					\
+	{ s, ADD10, W_BASE, "credito" },				\
+	{ s, ADD10, W_CREDIT_FULL, "moeda_devolvida" }
+
+#define WCET_SELL(s)							\
+	{ s, SEL, W_STARTED, "sessao_comecou" },			\
+	{ s, SEL, W_SOLD_OUT, "esgotada" },				\
+	{ s, SEL, W_NO_CREDIT, "sem_credito" },				\
+	{ s, SEL, W_NO_CHANGE, "sem_troco" },				\
+	{ s, SEL, W_TICKET, "bilhete" }
+
+static const struct wcet_case wcet_cases[] = {
+	{ MENU, NONE, W_BASE, "ignorado" },
+	WCET_COINS(MENU),
+	{ MENU, UP, W_BASE, "mostrar_filme" },
+	{ MENU, DOWN, W_BASE, "mostrar_filme" },
+	{ MENU, SEL, W_BASE, "ignorado" },
+	{ MENU, RET, W_BASE, "devolver_0" },
+	{ MENU, RET, W_CREDIT, "devolver_credito" },
+
+	{ MOVIES, NONE, W_BASE, "ignorado" },
+	WCET_COINS(MOVIES),
+	{ MOVIES, UP, W_BASE, "filme_seguinte" },
+	{ MOVIES, DOWN, W_BASE, "filme_anterior" },
+	WCET_SELL(MOVIES),
+	{ MOVIES, RET, W_BASE, "devolver_0" },
+	{ MOVIES, RET, W_CREDIT, "devolver_credito" },
+
+	{ UPDATE_CREDIT, NONE, W_BASE, "ignorado" },
+	WCET_COINS(UPDATE_CREDIT),
+	{ UPDATE_CREDIT, UP, W_BASE, "mostrar_filme" },
+	{ UPDATE_CREDIT, DOWN, W_BASE, "mostrar_filme" },
+	{ UPDATE_CREDIT, SEL, W_NO_MOVIE, "sem_filme" },
+	WCET_SELL(UPDATE_CREDIT),
+	{ UPDATE_CREDIT, RET, W_CREDIT, "devolver_credito" },
+};
+
+/** @brief Variantes de execuçao */
+enum wcet_variant {
+	WCET_WARM,	/**< cache quente: uma execuçao de aquecimento antes das medidas */
+	WCET_COLD,	/**< cache invalidada antes de cada execuçao */
+	WCET_NO_CACHE,	/**< cache desligada durante a execuçao */
+	WCET_VARIANTS
+};
+
+static const char *const variant_name[WCET_VARIANTS] = { "quente", "fria", "sem_cache" };
+static const char *const state_name[NUM_STATES] = { "MENU", "MOVIES", "UPDATE_CREDIT" };
+static const char *const event_name[NUM_EVENTS] = {
+	"NONE", "ADD1", "ADD2", "ADD5", "ADD10", "UP", "DOWN", "SEL", "RET"
+};
+
+static uint32_t samples[WCET_RUNS];
+/** @brief Sessao que ainda se pode comprar e sessao que ja começou (UINT16_MAX se nao houver) */
+static uint16_t idx_open, idx_started;
+
+static void wcet_cache(enum wcet_variant v, bool before)
+{
+#ifdef WCET_HAS_ICACHE
+	if (v == WCET_COLD && before) {
+		/* desligar e voltar a ligar a cache invalida o seu conteudo */
+		nrf_nvmc_icache_config_set(NRF_NVMC, NRF_NVMC_ICACHE_DISABLE);
+		nrf_nvmc_icache_config_set(NRF_NVMC, NRF_NVMC_ICACHE_ENABLE);
+	} else if (v == WCET_NO_CACHE) {
+		nrf_nvmc_icache_config_set(NRF_NVMC, before ? NRF_NVMC_ICACHE_DISABLE :
+							      NRF_NVMC_ICACHE_ENABLE);
+	}
+#endif
+}
+
+/** @brief Prepara o painel 0, os lugares e o troco para um caso
+ * @return false se o caso nao for possivel com este catalogo */
+static bool wcet_prepare(const struct wcet_case *c)
+{
+	const struct catalog *cat = catalog_get();
+	uint16_t idx = idx_open;
+	uint8_t coins[CHANGE_NUM_COINS];
+	int credit = c->state == UPDATE_CREDIT ? 5 : 0;
+	uint8_t same_movie = c->state == MOVIES ? 0 : 1;
+
+	if (c->setup == W_STARTED) {
+		if (idx_started == UINT16_MAX) {
+			return false;
+		}
+		idx = idx_started;
+	}
+	/* Stock inicial e lugares livres: o caso anterior pode ter vendido ou pago troco */
+	change_init();
+	if (seats_free(idx) == 0) {
+		seats_init(cat);
+	}
+
+	switch (c->setup) {
+	case W_BASE:
+		break;
+	case W_CREDIT_FULL:
+		credit = CHANGE_MAX;
+		break;
+	case W_CREDIT:
+		/* 10 + 5 + 2 + 1: uma moeda de cada tubo */
+		credit = 18;
+		break;
+	case W_NO_CREDIT:
+		credit = 0;
+		same_movie = 0;
+		break;
+	case W_STARTED:
+	case W_NO_MOVIE:
+	case W_SOLD_OUT:
+	case W_NO_CHANGE:
+	case W_TICKET:
+		credit = catalog_price(cat, idx) + 1;
+		same_movie = c->setup == W_NO_MOVIE;
+		break;
+	}
+	if (c->setup == W_SOLD_OUT) {
+		while (seats_take(idx) >= 0) {
+		}
+	}
+	if (c->setup == W_NO_CHANGE) {
+		/* Sem moedas de 1: o credito restante (1 EUR) deixa de ter troco */
+		while (change_can_pay(1) && change_payout(1, coins) == 0) {
+		}
+	}
+	vm_test_prepare(c->state, credit, idx, same_movie);
+	return true;
+}
+
+/** @brief Ordena as amostras (insertion sort: poucas centenas, uma vez por caso) */
+static void wcet_sort(uint32_t *v, int n)
+{
+	uint32_t x;
+	int i, j;
+
+	for (i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = x;
+	}
+}
+
+/** @brief Percentil p (0-100) das amostras ordenadas */
+static uint32_t wcet_pct(int p)
+{
+	return samples[(WCET_RUNS - 1) * p / 100];
+}
+
+/** @brief Corre um caso numa variante e imprime a linha da tabela */
+static enum wcet_result wcet_case_run(const struct wcet_case *c, enum wcet_variant v)
+{
+	uint32_t budget_us = (c->ev == UP || c->ev == DOWN) ? CONFIG_VENDING_WCET_BUDGET_DISPLAY_US :
+							      CONFIG_VENDING_WCET_BUDGET_US;
+	States final = c->state;
+	timing_t t0, t1;
+	uint32_t max_us;
+	unsigned int key;
+	int i;
+
+	for (i = (v == WCET_WARM) ? -1 : 0; i < WCET_RUNS; i++) {
+		if (!wcet_prepare(c)) {
+			printk("WCET,%s,%s,%s,%s,,0,,,,,,,%u,N/A\n", state_name[c->state],
+			       event_name[c->ev], c->path, variant_name[v], budget_us);
+			return WCET_NA;
+		}
+		/* A saida da execuçao anterior tem de estar enviada: mede-se a escrita no buffer
+		 * e nao o descarte por buffer cheio */
+		output_flush(WCET_FLUSH_MS);
+
+		key = irq_lock();
+		wcet_cache(v, true);
+		t0 = timing_counter_get();
+		vm_test_dispatch(c->ev);
+		t1 = timing_counter_get();
+		wcet_cache(v, false);
+		irq_unlock(key);
+
+		if (i >= 0) {
+			samples[i] = (uint32_t)timing_cycles_get(&t0, &t1);
+		}
+		final = vm_test_state();
+	}
+
+	wcet_sort(samples, WCET_RUNS);
+	max_us = (uint32_t)(timing_cycles_to_ns(samples[WCET_RUNS - 1]) / 1000U);
+	printk("WCET,%s,%s,%s,%s,%s,%u,%u,%u,%u,%u,%u,%u,%u,%s\n", state_name[c->state],
+	       event_name[c->ev], c->path, variant_name[v], state_name[final], WCET_RUNS,
+	       samples[0], wcet_pct(50), wcet_pct(90), wcet_pct(99), samples[WCET_RUNS - 1], max_us,
+	       budget_us, max_us <= budget_us ? "PASS" : "FAIL");
+	return max_us <= budget_us ? WCET_PASS : WCET_OVER;
+}
+
+void fsm_wcet_run(void)
+{
+	bool covered[NUM_STATES][NUM_EVENTS] = { 0 };
+	const struct catalog *cat = catalog_get();
+	int variants = IS_ENABLED(WCET_HAS_ICACHE) ? WCET_VARIANTS : 1;
+	int failed = 0;
+	int missing = 0;
+	int na = 0;
+	size_t k;
+	int s, e, v;
+	uint16_t i;
+
+	idx_open = idx_started = UINT16_MAX;
+	for (i = 0; i < catalog_count(cat); i++) {
+		if (catalog_bookable(i) && idx_open == UINT16_MAX) {
+			idx_open = i;
+		} else if (!catalog_bookable(i) && idx_started == UINT16_MAX) {
+			idx_started = i;
+		}
+	}
+	if (idx_open == UINT16_MAX) {
+		printk("WCET RESULT FAIL (nenhuma sessao por começar no catalogo)\n");
+		return;
+	}
+
+	/* As açoes reais escrevem no diario: os registos das medidas nao podem chegar à flash */
+	journal_divert(true);
+	timing_init();
+	timing_start();
+	output_flush(WCET_FLUSH_MS);
+	printk("WCET,estado,evento,caminho,variante,estado_final,execucoes,min,p50,p90,p99,max,"
+	       "max_us,orcamento_us,resultado\n");
+
+	for (k = 0; k < ARRAY_SIZE(wcet_cases); k++) {
+		for (v = 0; v < variants; v++) {
+			/* o texto da transiçao sai antes da linha da tabela */
+			switch (wcet_case_run(&wcet_cases[k], (enum wcet_variant)v)) {
+			case WCET_PASS:
+				covered[wcet_cases[k].state][wcet_cases[k].ev] = true;
+				break;
+			case WCET_OVER:
+				covered[wcet_cases[k].state][wcet_cases[k].ev] = true;
+				failed++;
+				break;
+			case WCET_NA:
+				na++;
+				break;
+			}
+			output_flush(WCET_FLUSH_MS);
+		}
+	}
+	for (s = 0; s < NUM_STATES; s++) {
+		for (e = 0; e < NUM_EVENTS; e++) {
+			if (!covered[s][e]) {
+				printk("WCET: par %s/%s sem caso\n", state_name[s], event_name[e]);
+				missing++;
+			}
+		}
+	}
+
+	timing_stop();
+	/* Repor o painel 0, os lugares e o troco para o funcionamento normal */
+	change_init();
+	seats_init(cat);
+	vm_test_prepare(MENU, 0, 0, 1);
+	journal_divert(false);
+	output_flush(WCET_FLUSH_MS);
+
+	if (failed || missing) {
+		printk("WCET RESULT FAIL (%d casos acima do orcamento, %d pares sem caso, %d N/A)\n",
+		       failed, missing, na);
+	} else {
+		printk("WCET RESULT %s (%u casos, %d variantes, %d execucoes, %d N/A)\n",
+		       IS_ENABLED(WCET_TIMED) ? "PASS" : "COVERAGE", (uint32_t)ARRAY_SIZE(wcet_cases),
+		       variants, WCET_RUNS, na);
+	}
+#ifdef CONFIG_BOARD_NATIVE_POSIX
+	posix_exit(failed || missing ? 1 : 0);
+#endif
+}
@@ -0,0 +1,269 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file journal.c
+* \brief Diario de vendas em NVS com escrita em grupo (ver journal.h)
+*
+* Os blocos sao guardados em CONFIG_VENDING_JOURNAL_SLOTS ids NVS usados de forma circular
+* (id = JOURNAL_ID_BASE + numero do bloco % slots); o NVS ja escreve de forma sequencial e
+* distribui o desgaste pelos setores. Dois buffers em RAM permitem que a maquina de estados
+* continue a registar enquanto o bloco anterior esta a ser escrito.
+*
+* As escritas correm num workqueue proprio, preemptivel e de prioridade inferior à da maquina
+* de estados (CONFIG_VENDING_JOURNAL_PRIORITY): o workqueue do sistema é cooperativo e uma
+* escrita lenta em flash atrasaria o despacho das moedas ate terminar.
+*/
+
+#include <zephyr.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+
+#include "vending.h"
+#include "journal.h"
+
+#define JOURNAL_BATCH CONFIG_VENDING_JOURNAL_BATCH
+#define JOURNAL_SLOTS CONFIG_VENDING_JOURNAL_SLOTS
+#define JOURNAL_ID_BASE 0x100
+#define JOURNAL_SECTORS 3U
+
+/** @brief Bloco escrito em flash: cabeçalho + registos */
+struct journal_block {
+	uint32_t number;	/**< numero do bloco (crescente) */
+	uint16_t count;		/**< registos validos */
+	uint16_t crc;		/**< crc16 dos registos */
+	struct journal_rec rec[JOURNAL_BATCH];
+};
+
+static struct nvs_fs fs;
+static bool journal_ready;
+
+/** @brief Buffers de registos: um a encher, outro a ser escrito */
+static struct journal_block blocks[2];
+static uint8_t fill_idx;
+static uint32_t next_number;
+static struct k_spinlock journal_lock;
+static struct journal_stats stats;
+static uint64_t commit_total_us;
+/** @brief Registos desviados (journal_divert()): nada é escrito em flash */
+static bool diverted;
+
+static void journal_commit_work(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(journal_work, journal_commit_work);
+
+/** @brief Thread (workqueue) das escritas em flash */
+static K_THREAD_STACK_DEFINE(journal_stack, CONFIG_VENDING_JOURNAL_STACK_SIZE);
+static struct k_work_q journal_q;
+
+static size_t journal_block_size(uint16_t count)
+{
+	return offsetof(struct journal_block, rec) + count * sizeof(struct journal_rec);
+}
+
+/** @brief Escreve o bloco que estava a encher (workqueue journal_q) */
+static void journal_commit_work(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&journal_lock);
+	struct journal_block *b = &blocks[fill_idx];
+	uint32_t t0, us = 0;
+	ssize_t ret = 0;
+	bool drop;
+
+	if (b->count == 0) {
+		k_spin_unlock(&journal_lock, key);
+		return;
+	}
+	/* Trocar de buffer: novos registos vao para o outro enquanto este é escrito */
+	fill_idx ^= 1U;
+	blocks[fill_idx].count = 0;
+	drop = diverted;
+	k_spin_unlock(&journal_lock, key);
+
+	if (!drop) {
+		b->number = next_number++;
+		b->crc = crc16_ccitt(0xffff, (const uint8_t *)b->rec,
+				     b->count * sizeof(struct journal_rec));
+
+		t0 = k_cycle_get_32();
+		ret = nvs_write(&fs, JOURNAL_ID_BASE + (b->number % JOURNAL_SLOTS), b,
+				journal_block_size(b->count));
+		us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+	}
+
+	key = k_spin_lock(&journal_lock);
+	if (drop) {
+		/* Bloco desviado (journal_divert()): descartado sem tocar na flash */
+	} else if (ret < 0) {
+		stats.lost += b->count;
+	} else {
+		stats.commits++;
+		stats.bytes += (uint32_t)ret;
+		commit_total_us += us;
+		stats.commit_max_us = MAX(stats.commit_max_us, us);
+	}
+	/* Registos acumulados durante a escrita: cheio escreve ja, senao apos o atraso de grupo */
+	if (blocks[fill_idx].count == JOURNAL_BATCH) {
+		k_work_reschedule_for_queue(&journal_q, &journal_work, K_NO_WAIT);
+	} else if (blocks[fill_idx].count > 0) {
+		k_work_schedule_for_queue(&journal_q, &journal_work,
+					  K_MSEC(CONFIG_VENDING_JOURNAL_COMMIT_MS));
+	}
+	k_spin_unlock(&journal_lock, key);
+}
+
+void journal_append(uint8_t lane, enum journal_type type, int amount, uint16_t session, int balance)
+{
+	k_spinlock_key_t key;
+	struct journal_block *b;
+
+	if (!journal_ready) {
+		return;
+	}
+
+	key = k_spin_lock(&journal_lock);
+	b = &blocks[fill_idx];
+	if (b->count == JOURNAL_BATCH) {
+		/* os dois buffers estao cheios: nao bloquear a maquina de estados */
+		stats.lost++;
+	} else {
+		b->rec[b->count++] = (struct journal_rec){
+			.type = type,
+			.lane = lane,
+			.amount = (uint16_t)amount,
+			.session = session,
+			.balance = (uint16_t)balance,
+		};
+		if (!diverted) {
+			stats.records++;
+			if (type == JOURNAL_TICKET) {
+				stats.tickets++;
+			}
+		}
+		if (b->count == JOURNAL_BATCH) {
+			k_work_reschedule_for_queue(&journal_q, &journal_work, K_NO_WAIT);
+		} else if (b->count == 1) {
+			k_work_schedule_for_queue(&journal_q, &journal_work,
+						  K_MSEC(CONFIG_VENDING_JOURNAL_COMMIT_MS));
+		}
+	}
+	k_spin_unlock(&journal_lock, key);
+}
+
+/** @brief Recuperaçao: devolve o ultimo saldo registado de cada painel
+ *
+ * Com um so painel basta o bloco mais recente. Com varios, o ultimo registo de cada painel
+ * pode estar num bloco mais antigo: guarda-se, por painel, o saldo do bloco com numero
+ * mais alto em que o painel aparece (dentro do bloco, o ultimo registo).
+*/
+static void journal_replay(int *balance, uint8_t lanes)
+{
+	struct journal_block *b = &blocks[0];
+	uint32_t lane_best[VM_LANES];
+	bool lane_found[VM_LANES];
+	uint32_t best = 0;
+	bool found = false;
+	ssize_t len;
+	int slot, i;
+	uint8_t lane;
+
+	lanes = MIN(lanes, VM_LANES);
+	for (lane = 0; lane < lanes; lane++) {
+		balance[lane] = 0;
+		lane_found[lane] = false;
+	}
+	for (slot = 0; slot < JOURNAL_SLOTS; slot++) {
+		len = nvs_read(&fs, JOURNAL_ID_BASE + slot, b, sizeof(*b));
+		if (len < (ssize_t)journal_block_size(1) || b->count == 0 ||
+		    b->count > JOURNAL_BATCH || len != (ssize_t)journal_block_size(b->count)) {
+			continue;
+		}
+		if (b->crc != crc16_ccitt(0xffff, (const uint8_t *)b->rec,
+					  b->count * sizeof(struct journal_rec))) {
+			continue;
+		}
+		if (!found || (int32_t)(b->number - best) > 0) {
+			found = true;
+			best = b->number;
+		}
+		for (i = 0; i < b->count; i++) {
+			lane = b->rec[i].lane;
+			if (lane >= lanes) {
+				continue;
+			}
+			if (!lane_found[lane] || (int32_t)(b->number - lane_best[lane]) >= 0) {
+				lane_found[lane] = true;
+				lane_best[lane] = b->number;
+				balance[lane] = b->rec[i].balance;
+			}
+		}
+	}
+	next_number = found ? best + 1 : 0;
+	b->count = 0;
+}
+
+int journal_init(int *balance, uint8_t lanes)
+{
+	struct flash_pages_info info;
+	uint32_t t0;
+	int ret;
+	uint8_t lane;
+
+	for (lane = 0; lane < lanes; lane++) {
+		balance[lane] = 0;
+	}
+	fs.flash_device = FLASH_AREA_DEVICE(storage);
+	if (!device_is_ready(fs.flash_device)) {
+		printk("Error: flash device not ready, diario desativado\n");
+		return -ENODEV;
+	}
+	fs.offset = FLASH_AREA_OFFSET(storage);
+	ret = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+	if (ret < 0) {
+		return ret;
+	}
+	fs.sector_size = info.size;
+	fs.sector_count = JOURNAL_SECTORS;
+	ret = nvs_mount(&fs);
+	if (ret < 0) {
+		printk("Error: nvs_mount failed, error:%d, diario desativado\n", ret);
+		return ret;
+	}
+	stats.sector_size = info.size;
+
+	t0 = k_cycle_get_32();
+	journal_replay(balance, lanes);
+	stats.replay_us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+
+	k_work_queue_start(&journal_q, journal_stack, K_THREAD_STACK_SIZEOF(journal_stack),
+			   CONFIG_VENDING_JOURNAL_PRIORITY,
+			   &(const struct k_work_queue_config){ .name = "journal" });
+	journal_ready = true;
+	printk("Diario: proximo bloco %u, saldo %d EUR (painel 0), recuperado em %u us\n",
+	       next_number, balance[0], stats.replay_us);
+	return 0;
+}
+
+void journal_divert(bool on)
+{
+	k_spinlock_key_t key = k_spin_lock(&journal_lock);
+
+	if (!on && diverted) {
+		/* Registos desviados ainda por descartar: nunca chegam à flash */
+		blocks[fill_idx].count = 0;
+	}
+	diverted = on;
+	k_spin_unlock(&journal_lock, key);
+}
+
+void journal_stats_get(struct journal_stats *st)
+{
+	k_spinlock_key_t key = k_spin_lock(&journal_lock);
+
+	*st = stats;
+	st->commit_avg_us = stats.commits ? (uint32_t)(commit_total_us / stats.commits) : 0U;
+	k_spin_unlock(&journal_lock, key);
+}
@@ -0,0 +1,74 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file journal.h
+* \brief Diario de vendas persistente (NVS) com escrita em grupo
+*
+* Cada operaçao (credito inserido, bilhete emitido, credito devolvido) gera um registo de
+* 8 bytes com o saldo resultante. Os registos sao acumulados em RAM e escritos em flash
+* num unico bloco (commit de grupo) quando o bloco enche ou passa
+* CONFIG_VENDING_JOURNAL_COMMIT_MS desde o primeiro registo pendente. No arranque o ultimo
+* registo de cada painel nos blocos guardados da o credito do respetivo cliente.
+*/
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <zephyr.h>
+
+/** @brief Tipos de registo */
+enum journal_type {
+	JOURNAL_CREDIT = 1,	/**< moeda inserida */
+	JOURNAL_TICKET,		/**< bilhete emitido */
+	JOURNAL_RETURN,		/**< credito devolvido */
+};
+
+/** @brief Registo do diario (8 bytes, multiplo do bloco de escrita da flash) */
+struct journal_rec {
+	uint8_t type;		/**< enum journal_type */
+	uint8_t lane;		/**< painel que gerou o registo */
+	uint16_t amount;	/**< valor da operaçao (EUR) */
+	uint16_t session;	/**< sessao do bilhete (indice do catalogo) */
+	uint16_t balance;	/**< credito depois da operaçao */
+};
+
+/** @brief Estatisticas do diario */
+struct journal_stats {
+	uint32_t records;	/**< registos aceites */
+	uint32_t tickets;	/**< bilhetes registados */
+	uint32_t commits;	/**< blocos escritos em flash */
+	uint32_t bytes;		/**< bytes escritos em flash */
+	uint32_t lost;		/**< registos perdidos (buffers cheios ou erro de escrita) */
+	uint32_t commit_max_us;	/**< pior tempo de escrita de um bloco */
+	uint32_t commit_avg_us;	/**< tempo medio de escrita de um bloco */
+	uint32_t replay_us;	/**< tempo da recuperaçao no arranque */
+	uint32_t sector_size;	/**< tamanho do setor da flash */
+};
+
+#ifdef CONFIG_VENDING_JOURNAL
+/** @brief Monta o NVS e procura o ultimo registo de cada painel
+ * @param balance recebe, para cada painel, o credito registado na sua ultima operaçao (0 se
+ *                o painel nao tiver registos nos blocos guardados)
+ * @param lanes numero de paineis (entradas de balance)
+ * @return 0 ou erro do NVS/flash (o diario fica desativado) */
+int journal_init(int *balance, uint8_t lanes);
+
+/** @brief Acrescenta um registo do painel lane ao bloco pendente (nao bloqueia, nao escreve em flash) */
+void journal_append(uint8_t lane, enum journal_type type, int amount, uint16_t session, int balance);
+
+/** @brief Le as estatisticas do diario */
+void journal_stats_get(struct journal_stats *st);
+
+/** @brief Desvia os registos (analise de WCET): journal_append() faz o mesmo trabalho, mas os
+ * blocos sao descartados em vez de escritos em flash e nao entram nas estatisticas.
+ * Ao terminar o desvio os registos ainda pendentes sao descartados. Ativar com o bloco
+ * pendente vazio (no arranque, antes de a maquina de estados correr). */
+void journal_divert(bool on);
+#else
+static inline void journal_append(uint8_t lane, enum journal_type type, int amount,
+				  uint16_t session, int balance) { }
+static inline void journal_divert(bool on) { }
+#endif
+
+#endif /* JOURNAL_H_ */
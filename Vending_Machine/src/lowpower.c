@@ -0,0 +1,118 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file lowpower.c
+* \brief Modo de baixo consumo entre clientes (ver lowpower.h)
+*
+* So a thread da maquina de estados chama estas funçoes, pelo que o estado nao precisa de
+* exclusao mutua. A corrente é estimada a partir do tempo passado em cada modo e de valores
+* tipicos do nRF52840 (ver LOWPOWER_*_NA); o calculo nao inclui os picos de CPU durante o
+* despacho, desprezaveis sem clientes. Para valores reais medir com um Power Profiler.
+*/
+
+#include <zephyr.h>
+
+#ifdef CONFIG_RAM_POWER_DOWN_LIBRARY
+#include <ram_pwrdn.h>
+#endif
+
+#include "lowpower.h"
+#include "buttons.h"
+#include "output.h"
+
+/** @brief System ON idle com o RTC a contar, botoes por SENSE, RAM da aplicaçao mantida (nA) */
+#define LOWPOWER_SLEEP_NA 3000U
+/** @brief Idle com a UARTE em receçao: o HFCLK fica ligado (ordem de grandeza, nA) */
+#define LOWPOWER_AWAKE_NA 600000U
+
+#define LOWPOWER_TIMEOUT_S CONFIG_VENDING_LOW_POWER_TIMEOUT_S
+
+static bool active;
+/** @brief Aguarda o fim do despacho do primeiro evento depois de acordar */
+static bool wake_pending;
+static uint32_t wake_edge;
+static int64_t sleep_start;
+static int64_t period_start;
+static uint64_t period_sleep_ms;
+static struct lowpower_stats stats;
+
+void lowpower_init(void)
+{
+#ifdef CONFIG_RAM_POWER_DOWN_LIBRARY
+	/* Todo o estado da aplicaçao é estatico: a RAM acima da imagem nunca é usada */
+	power_down_unused_ram();
+#endif
+	period_start = k_uptime_get();
+}
+
+int lowpower_enter(void)
+{
+	if (output_suspend() < 0) {
+		stats.refused++;
+		return -EBUSY;
+	}
+	buttons_suspend();
+	sleep_start = k_uptime_get();
+	active = true;
+	stats.entries++;
+	return 0;
+}
+
+void lowpower_exit(void)
+{
+	/* O timer da hora tambem acorda a thread: so um botao liga a UART de novo */
+	if (!active || !buttons_sensed(&wake_edge)) {
+		return;
+	}
+	buttons_resume();
+	output_resume();
+	period_sleep_ms += k_uptime_get() - sleep_start;
+	active = false;
+	wake_pending = true;
+}
+
+bool lowpower_active(void)
+{
+	return active;
+}
+
+void lowpower_response(uint32_t ts)
+{
+	uint32_t now;
+
+	if (!wake_pending) {
+		return;
+	}
+	wake_pending = false;
+	now = k_cycle_get_32();
+	stats.wake_edge_us = k_cyc_to_us_floor32(now - wake_edge);
+	stats.wake_event_us = k_cyc_to_us_floor32(now - ts);
+	stats.wake_max_us = MAX(stats.wake_max_us, stats.wake_edge_us);
+}
+
+void lowpower_stats_get(struct lowpower_stats *st)
+{
+	int64_t now = k_uptime_get();
+	uint64_t sleep_ms = period_sleep_ms;
+	uint64_t total_ms = now - period_start;
+	uint64_t na;
+
+	if (active) {
+		sleep_ms += now - sleep_start;
+		sleep_start = now;
+	}
+	na = total_ms ? (sleep_ms * LOWPOWER_SLEEP_NA +
+			 (total_ms - sleep_ms) * LOWPOWER_AWAKE_NA) / total_ms : 0U;
+	stats.sleep_ms = (uint32_t)sleep_ms;
+	stats.total_ms = (uint32_t)total_ms;
+	stats.avg_ua_x10 = (uint32_t)(na / 100U);
+	/* Uma hora sem clientes: acordada ate ao fim do tempo de inatividade, depois em baixo consumo */
+	stats.idle_hour_uah_x10 = (uint32_t)((LOWPOWER_TIMEOUT_S * (uint64_t)LOWPOWER_AWAKE_NA +
+					      (3600U - LOWPOWER_TIMEOUT_S) * (uint64_t)LOWPOWER_SLEEP_NA) /
+					     3600U / 100U);
+	*st = stats;
+
+	period_start = now;
+	period_sleep_ms = 0;
+}
@@ -0,0 +1,65 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file lowpower.h
+* \brief Modo de baixo consumo entre clientes, acordado pelos botoes
+*
+* Com CONFIG_VENDING_LOW_POWER, quando todos os paineis estao em MENU sem credito e nao chega
+* nenhum evento durante CONFIG_VENDING_LOW_POWER_TIMEOUT_S, a maquina de estados suspende a
+* UART da consola (a receçao assincrona mantem o HFCLK ligado) e passa os botoes para
+* interrupçoes por nivel (SENSE/PORT, sem canais GPIOTE IN). O SoC fica em System ON idle
+* com o RTC a contar: a RAM mantem-se, pelo que o credito, o filme selecionado e os indices
+* do catalogo estao prontos quando a primeira pressao o acorda. O System OFF foi excluido
+* porque acorda com um reset e para o RTC (perdia a hora do dia, os lugares e o troco).
+*/
+
+#ifndef LOWPOWER_H_
+#define LOWPOWER_H_
+
+#include <zephyr.h>
+
+/** @brief Estatisticas do modo de baixo consumo */
+struct lowpower_stats {
+	uint32_t entries;	/**< entradas no modo de baixo consumo */
+	uint32_t refused;	/**< entradas adiadas (saida ainda a enviar) */
+	uint32_t wake_edge_us;	/**< ultima resposta: do flanco que acordou ao fim do despacho */
+	uint32_t wake_event_us;	/**< ultima resposta: do evento confirmado ao fim do despacho */
+	uint32_t wake_max_us;	/**< pior wake_edge_us */
+	uint32_t sleep_ms;	/**< tempo em baixo consumo desde o ultimo relatorio */
+	uint32_t total_ms;	/**< duraçao do periodo do relatorio */
+	uint32_t avg_ua_x10;	/**< corrente media estimada no periodo (decimas de uA) */
+	uint32_t idle_hour_uah_x10; /**< estimativa para uma hora sem clientes (decimas de uAh) */
+};
+
+#ifdef CONFIG_VENDING_LOW_POWER
+
+/** @brief Desliga a RAM que nao é usada pela aplicaçao (nRF52, se disponivel) */
+void lowpower_init(void);
+
+/** @brief Entra no modo de baixo consumo (chamada pela maquina de estados em idle)
+ * @return 0 ou -EBUSY se a saida ainda tiver texto por enviar */
+int lowpower_enter(void);
+
+/** @brief A thread acordou em baixo consumo: sai do modo se foi acordada por um botao
+ * (os eventos do timer da hora sao tratados sem voltar a ligar a UART) */
+void lowpower_exit(void);
+
+/** @brief true entre lowpower_enter() e lowpower_exit() */
+bool lowpower_active(void);
+
+/** @brief Fim do despacho de um evento: mede a resposta ao primeiro evento apos acordar
+ * @param ts instante (k_cycle_get_32) em que o evento foi colocado na fila */
+void lowpower_response(uint32_t ts);
+
+/** @brief Le as estatisticas e a estimativa de consumo e começa um novo periodo */
+void lowpower_stats_get(struct lowpower_stats *st);
+
+#else
+
+static inline void lowpower_init(void) { }
+static inline void lowpower_response(uint32_t ts) { }
+
+#endif /* CONFIG_VENDING_LOW_POWER */
+
+#endif /* LOWPOWER_H_ */
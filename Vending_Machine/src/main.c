@@ -21,326 +21,923 @@
 #include <zephyr/devicetree.h> /* DT_NODELABEL() */
 #include <zephyr/sys/printk.h> /* printk */
 #include <zephyr/drivers/gpio.h> /* GPIO api */
+#ifdef CONFIG_VENDING_FSM_SMF
+#include <zephyr/smf.h> /* maquina de estados hierarquica */
+#endif
+
+#include "vending.h"
+#include "event_ring.h"
+#include "buttons.h"
+#include "fsm.h"
+#include "catalog.h"
+#include "catalog_loader.h"
+#include "catalog_delta.h"
+#include "catalog_details.h"
+#include "seats.h"
+#include "wallclock.h"
+#include "output.h"
+#include "change.h"
+#include "journal.h"
+#include "recorder.h"
+#include "lowpower.h"
+#include "trace.h"
+#include "sim_harness.h"
+
+#ifdef CONFIG_VENDING_THREAD_STATS
+#include <zephyr/debug/thread_analyzer.h>
+#endif
 
 /* Use a "big" sleep time to reduce CPU load (button detection int activated, not polled) */
 #define SLEEP_TIME_MS   60*1000 
 
-/** @brief Definiçao de array dos pinos usados
-	* set de pins used 
-	* buttons 1-4 on board (11,12,24,25)
-	* buttons 5-8 connected labeled A0...A3 (gpio pin 3,4,28,29) 
-	* array usado para identificaçao de qual butao foi clicado para identificar um evento */
-const uint8_t buttons_pins[] = { 11,12,24,25,3,4,28,29};
-
-//----------------------------------------------------------------
-/** @brief Definicao de eventos
- 	*  Enumeraçao de possiveis eventos criados pelos sistema */
-typedef enum {
-    NONE, ADD1, ADD2, ADD5, ADD10, UP, DOWN, SEL, RET
-} Event;
-
-/** @brief Definicao de Estados
- 	*  Enumeraçao de estados do sistema */
-typedef enum{
-    MENU, MOVIES, UPDATE_CREDIT
-} States;
-
-/** @brief Variavel para identificar qual filme apresentar no estado Movie
- *  flag para manter o movie_idx caso seja 1 mantem movie idx, caso 0 pode alterar o movie idx */
-static volatile int same_movie = 1;
-
-/** @brief Variavel eventos para tomar o valor do evento ocorrido
- * definir variavel evento que tera um valor consoante o evento ocorrido*/
-static volatile Event eventos = NONE;
-/** @brief Variavel estado para tomar o valor do estado seguinte 
- * definir variavel estado que irá tomar um valor consoante o evento ocorrido e estado atual */
-static volatile States estado = MENU;
-/** @brief Variavel Credito  
- * definir variavel credito que terá a quantia de credito introduzida pelo utilizador */
-static volatile int Credito = 0;
-
-/* Listas de filmes, horas e preço */
-/** @brief Quantidade de filmes */
-static volatile int num_movie = 5;
-
-/** @brief Lista de nomes dos Filmes 
- * array com os nomes dos filmes que podem ser comprados
-*/
-static volatile char Movie[]= {'A', 'A', 'A', 'B', 'B'};
-/** @brief Lista das Horas 
- * array com as horas das sessoes dos filmes 
+/** @brief Semaforo que acorda a maquina de estados
+ * dado pela callback dos botoes (buttons.c) depois de colocar eventos na fila; enquanto nao ha eventos
+ * a thread fica bloqueada e o kernel (tickless) pode colocar o CPU em idle */
+K_SEM_DEFINE(ev_sem, 0, 1);
+
+/** @brief Contexto de um painel (cliente)
+ * Cada painel tem a sua maquina de estados, fila de eventos, credito e filme selecionado.
+ * O catalogo, os lugares e o stock de troco sao partilhados; so a thread vm_fsm (o
+ * escalonador) lhes acede, por isso nao precisam de exclusao mutua. */
+struct vm_lane {
+#ifdef CONFIG_VENDING_FSM_SMF
+	/** @brief Maquina de estados hierarquica (SMF)
+	 * smf_ctx tem de ser o primeiro membro; as açoes do SMF so recebem o objeto, por isso o
+	 * evento a despachar segue aqui */
+	struct smf_ctx smf;
+	int ev;
+#else
+	/** @brief Maquina de estados
+	 * contem o estado atual (MENU, MOVIES, UPDATE_CREDIT) e a tabela de transiçoes vm_table */
+	struct fsm fsm;
+#endif
+	/** @brief Credito introduzido pelo cliente deste painel */
+	int credit;
+	/** @brief Posiçao da lista de filmes: aponta para o filme apresentado no estado MOVIES */
+	uint16_t movie_idx;
+	/** @brief 1 enquanto nao for apresentado nenhum filme (SEL em UPDATE_CREDIT nao emite bilhete),
+	 *  passa a 0 quando o estado MOVIES apresenta o filme e volta a 1 quando é emitido um bilhete */
+	uint8_t same_movie;
+	/** @brief Numero do painel (prefixo das mensagens e registos do diario) */
+	uint8_t id;
+	/** @brief Fila de eventos dos botoes deste painel
+	 * a callback coloca cada evento na fila e o escalonador retira-os por ordem,
+	 * assim nenhum evento é perdido quando chegam varios na mesma iteraçao */
+	struct event_ring ring;
+	/** @brief Eventos perdidos ja avisados */
+	uint32_t overflows_seen;
+};
+
+/** @brief Paineis servidos por esta maquina (CONFIG_VENDING_LANES) */
+static struct vm_lane lanes[VM_LANES];
+
+/** @brief Mensagem de um painel: com mais de um painel é prefixada pelo numero do painel */
+#if VM_LANES > 1
+#define lane_printf(l, fmt, ...) vm_printf("[%u] " fmt, (l)->id, ##__VA_ARGS__)
+#else
+#define lane_printf(l, fmt, ...) ((void)(l), vm_printf(fmt, ##__VA_ARGS__))
+#endif
+
+static States vm_state(struct vm_lane *l);
+
+
+
+//---------------------------------------------------------
+/* Guardas e açoes da maquina de estados.
+ * Cada açao corresponde a um bloco que antes estava repetido em varios estados do switch.
+ * ctx é o painel (struct vm_lane) que recebeu o evento */
+
+/** @brief Valor de cada moeda (indexado pelo evento) */
+static const uint8_t coin_value[NUM_EVENTS] = { [ADD1] = 1, [ADD2] = 2, [ADD5] = 5, [ADD10] = 10 };
+
+/** @brief Guarda: ainda nao foi apresentado nenhum filme no estado MOVIES */
+static bool no_movie_selected(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	return l->same_movie == 1;
+}
+
+/** @brief Guarda: a sessao selecionada ja começou */
+static bool session_started(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	return !catalog_bookable(l->movie_idx);
+}
+
+/** @brief Guarda: a sessao selecionada esta esgotada */
+static bool sold_out(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	return seats_free(l->movie_idx) == 0;
+}
+
+/** @brief Guarda: credito insuficiente para o filme selecionado */
+static bool not_enough_credit(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	return l->credit < catalog_price(catalog_get(), l->movie_idx);
+}
+
+/** @brief Guarda: a moeda faria o credito ultrapassar o maximo (CHANGE_MAX) */
+static bool credit_full(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	return l->credit + coin_value[ev] > CHANGE_MAX;
+}
+
+/** @brief Guarda: depois da compra nao ha troco exato para o credito restante
+ * O stock é partilhado: com varios paineis, o credito que os outros ainda podem pedir de
+ * volta fica reservado e o troco desta compra tem de sair das moedas que sobram */
+static bool no_change(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+	int rest = l->credit - catalog_price(catalog_get(), l->movie_idx);
+#if VM_LANES > 1
+	int amount[VM_LANES];
+	struct vm_lane *o;
+	int n = 1;
+
+	amount[0] = rest;
+	for (o = lanes; o < lanes + VM_LANES; o++) {
+		if (o != l && o->credit > 0) {
+			amount[n++] = o->credit;
+		}
+	}
+	if (n > 1) {
+		return !change_can_pay_all(amount, n);
+	}
+#endif
+	return !change_can_pay(rest);
+}
+
+/** @brief Açao: devolver a moeda que ultrapassa o credito maximo */
+static void reject_coin(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	lane_printf(l, "Moeda de %d EUR devolvida: credito maximo %d EUR\n", coin_value[ev], CHANGE_MAX);
+}
+
+/** @brief Açao: adicionar o valor da moeda inserida ao credito */
+static void add_credit(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	l->credit += coin_value[ev];
+	change_deposit(coin_value[ev]);
+	journal_append(l->id, JOURNAL_CREDIT, coin_value[ev], 0, l->credit);
+	lane_printf(l, "Credito Atual: %d EUR\n\r", l->credit);
+}
+
+/** @brief Açao: devolver o credito com o menor numero de moedas do stock */
+static void return_credit(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+	uint8_t coins[CHANGE_NUM_COINS];
+
+	if (l->credit == 0) {
+		lane_printf(l, "0 EUR return\n");
+		return;
+	}
+	if (change_payout(l->credit, coins) < 0) {
+		/* So acontece com credito recuperado do diario acima do stock atual */
+		lane_printf(l, "Sem troco para %d EUR, chame o funcionario\n", l->credit);
+		return;
+	}
+	lane_printf(l, "%d EUR return (%ux10 %ux5 %ux2 %ux1)\n", l->credit, coins[0], coins[1],
+		    coins[2], coins[3]);
+	journal_append(l->id, JOURNAL_RETURN, l->credit, 0, 0);
+	l->credit = 0;
+}
+
+/** @brief Apresentar o filme apontado por movie_idx */
+static void print_movie(struct vm_lane *l)
+{
+	const struct catalog *cat = catalog_get();
+	struct catalog_details det;
+
+	/* O titulo é lido diretamente do pool de strings, sem copia */
+	lane_printf(l, "Movie %s, %dH00 session \n", catalog_title_str(cat, l->movie_idx), catalog_hour(cat, l->movie_idx));
+	if (catalog_details_get(catalog_title_str(cat, l->movie_idx), &det) == 0) {
+		lane_printf(l, "%s. %s\n", det.rating, det.synopsis);
+	}
+	if (!catalog_bookable(l->movie_idx)) {
+		lane_printf(l, "Sessao ja comecou\n");
+	}
+	lane_printf(l, "Custo: %d EUR, %u lugares livres\n", catalog_price(cat, l->movie_idx),
+		    seats_free(l->movie_idx));
+	lane_printf(l, "Saldo: %d EUR\n", l->credit);
+}
+
+/** @brief Açao: entrar no estado MOVIES apresentando o filme selecionado ou o primeiro da lista */
+static void show_movie(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	/* A sessao escolhida antes ja começou: apresentar a proxima */
+	if (!catalog_bookable(l->movie_idx) && catalog_upcoming_count() > 0) {
+		l->movie_idx = catalog_upcoming_first();
+	}
+	print_movie(l);
+	l->same_movie = 0;
+}
+
+/** @brief Açao: avançar para o filme seguinte (ou grupo seguinte, ver catalog_browse()) */
+static void next_movie(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	l->movie_idx = catalog_browse(l->movie_idx, true);
+	print_movie(l);
+}
+
+/** @brief Açao: recuar para o filme anterior (ou sessao seguinte do grupo, ver catalog_browse()) */
+static void prev_movie(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	l->movie_idx = catalog_browse(l->movie_idx, false);
+	print_movie(l);
+}
+
+/** @brief Açao: tentativa de compra sem filme selecionado */
+static void warn_no_movie(void *ctx, int ev)
+{
+	lane_printf((struct vm_lane *)ctx, "Ainda não selecionou filme\n");
+}
+
+/** @brief Açao: tentativa de compra com credito insuficiente */
+static void warn_no_credit(void *ctx, int ev)
+{
+	lane_printf((struct vm_lane *)ctx, "Not enough Credit. Ticket not issued!\n");
+}
+
+/** @brief Açao: tentativa de compra de uma sessao que ja começou */
+static void warn_started(void *ctx, int ev)
+{
+	lane_printf((struct vm_lane *)ctx, "Sessao ja comecou. Ticket not issued!\n");
+}
+
+/** @brief Açao: tentativa de compra numa sessao esgotada */
+static void warn_sold_out(void *ctx, int ev)
+{
+	lane_printf((struct vm_lane *)ctx, "Sessao esgotada. Ticket not issued!\n");
+}
+
+/** @brief Açao: venda recusada porque o credito restante nao teria troco */
+static void warn_no_change(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+
+	change_refused();
+	lane_printf(l, "Sem troco para %d EUR. Ticket not issued!\n",
+		    l->credit - catalog_price(catalog_get(), l->movie_idx));
+}
+
+/** @brief Açao: emitir o bilhete, descontar o preço e voltar a exigir a escolha de um filme
+ * seats_take() e o stock de troco sao partilhados pelos paineis; as guardas e esta açao
+ * correm seguidas no escalonador, pelo que o lugar verificado por sold_out() continua livre */
+static void issue_ticket(void *ctx, int ev)
+{
+	struct vm_lane *l = ctx;
+	const struct catalog *cat = catalog_get();
+	int seat = seats_take(l->movie_idx);
+
+	lane_printf(l, "Ticket for movie %s, session %dH00 issued!\n", catalog_title_str(cat, l->movie_idx), catalog_hour(cat, l->movie_idx));
+	lane_printf(l, "Lugar %c%d\n", 'A' + seat_row(seat), seat_col(seat) + 1);
+	l->credit = l->credit - catalog_price(cat, l->movie_idx);
+	journal_append(l->id, JOURNAL_TICKET, catalog_price(cat, l->movie_idx), l->movie_idx, l->credit);
+	lane_printf(l, "Remaining credit %d \n", l->credit);
+	l->same_movie = 1;
+}
+
+/** @brief Catalogo trocado entre dois eventos: ajustar a sessao selecionada de cada painel e os lugares */
+static void catalog_changed(void)
+{
+	const struct catalog *cat = catalog_get();
+	struct catalog_swap_stats sw;
+	struct vm_lane *l;
+
+	catalog_swap_stats_get(&sw);
+	vm_printf("Catalogo atualizado: versao %u, %u sessoes (troca em %u us)\n", sw.version,
+		  catalog_count(cat), sw.switch_last_us);
+	seats_remap(cat);
+	for (l = lanes; l < lanes + VM_LANES; l++) {
+		if (l->movie_idx >= catalog_count(cat)) {
+			l->movie_idx = 0;
+			l->same_movie = 1;
+		}
+		/* O cliente que esta a ver um filme ve os dados novos antes de poder comprar */
+		if (vm_state(l) == MOVIES) {
+			print_movie(l);
+		}
+	}
+}
+
+#ifdef CONFIG_VENDING_FSM_TABLE
+/* Transiçoes partilhadas por varios estados */
+#define T_ADD_CREDIT(state)	FSM_CELL({ credit_full, reject_coin, state }, \
+					 { NULL, add_credit, UPDATE_CREDIT })
+#define T_RETURN	FSM_CELL({ NULL, return_credit, MENU })
+#define T_SHOW_MOVIE	FSM_CELL({ NULL, show_movie, MOVIES })
+
+/** @brief Tabela de transiçoes [estado][evento] (const, fica em flash) */
+static const struct fsm_cell vm_table[NUM_STATES * NUM_EVENTS] = {
+	/* MENU */
+	[MENU * NUM_EVENTS + NONE]	= FSM_IGNORE,
+	[MENU * NUM_EVENTS + ADD1]	= T_ADD_CREDIT(MENU),
+	[MENU * NUM_EVENTS + ADD2]	= T_ADD_CREDIT(MENU),
+	[MENU * NUM_EVENTS + ADD5]	= T_ADD_CREDIT(MENU),
+	[MENU * NUM_EVENTS + ADD10]	= T_ADD_CREDIT(MENU),
+	[MENU * NUM_EVENTS + UP]	= T_SHOW_MOVIE,
+	[MENU * NUM_EVENTS + DOWN]	= T_SHOW_MOVIE,
+	[MENU * NUM_EVENTS + SEL]	= FSM_IGNORE,
+	[MENU * NUM_EVENTS + RET]	= T_RETURN,
+
+	/* MOVIES */
+	[MOVIES * NUM_EVENTS + NONE]	= FSM_IGNORE,
+	[MOVIES * NUM_EVENTS + ADD1]	= T_ADD_CREDIT(MOVIES),
+	[MOVIES * NUM_EVENTS + ADD2]	= T_ADD_CREDIT(MOVIES),
+	[MOVIES * NUM_EVENTS + ADD5]	= T_ADD_CREDIT(MOVIES),
+	[MOVIES * NUM_EVENTS + ADD10]	= T_ADD_CREDIT(MOVIES),
+	[MOVIES * NUM_EVENTS + UP]	= FSM_CELL({ NULL, next_movie, MOVIES }),
+	[MOVIES * NUM_EVENTS + DOWN]	= FSM_CELL({ NULL, prev_movie, MOVIES }),
+	[MOVIES * NUM_EVENTS + SEL]	= FSM_CELL({ session_started, warn_started, MOVIES },
+						   { sold_out, warn_sold_out, MOVIES },
+						   { not_enough_credit, warn_no_credit, MOVIES },
+						   { no_change, warn_no_change, MOVIES },
+						   { NULL, issue_ticket, MENU }),
+	[MOVIES * NUM_EVENTS + RET]	= T_RETURN,
+
+	/* UPDATE_CREDIT */
+	[UPDATE_CREDIT * NUM_EVENTS + NONE]	= FSM_IGNORE,
+	[UPDATE_CREDIT * NUM_EVENTS + ADD1]	= T_ADD_CREDIT(UPDATE_CREDIT),
+	[UPDATE_CREDIT * NUM_EVENTS + ADD2]	= T_ADD_CREDIT(UPDATE_CREDIT),
+	[UPDATE_CREDIT * NUM_EVENTS + ADD5]	= T_ADD_CREDIT(UPDATE_CREDIT),
+	[UPDATE_CREDIT * NUM_EVENTS + ADD10]	= T_ADD_CREDIT(UPDATE_CREDIT),
+	[UPDATE_CREDIT * NUM_EVENTS + UP]	= T_SHOW_MOVIE,
+	[UPDATE_CREDIT * NUM_EVENTS + DOWN]	= T_SHOW_MOVIE,
+	[UPDATE_CREDIT * NUM_EVENTS + SEL]	= FSM_CELL({ no_movie_selected, warn_no_movie, UPDATE_CREDIT },
+							   { session_started, warn_started, UPDATE_CREDIT },
+							   { sold_out, warn_sold_out, UPDATE_CREDIT },
+							   { not_enough_credit, warn_no_credit, UPDATE_CREDIT },
+							   { no_change, warn_no_change, UPDATE_CREDIT },
+							   { NULL, issue_ticket, MENU }),
+	[UPDATE_CREDIT * NUM_EVENTS + RET]	= T_RETURN,
+};
+
+/** @brief Estado atual da maquina de estados de um painel */
+static States vm_state(struct vm_lane *l)
+{
+	return l->fsm.state;
+}
+
+/** @brief Despacha um evento do painel l pela tabela vm_table */
+static void vm_dispatch(struct vm_lane *l, int ev)
+{
+	fsm_dispatch(&l->fsm, ev, l);
+}
+
+/** @brief Coloca a maquina de estados de um painel no estado s (MENU no arranque) */
+static void vm_start(struct vm_lane *l, States s)
+{
+	fsm_init(&l->fsm, vm_table, NUM_STATES, NUM_EVENTS, s);
+}
+#else /* CONFIG_VENDING_FSM_SMF */
+/* Versao hierarquica: MENU, MOVIES e UPDATE_CREDIT sao filhos de SESSION, que trata as
+ * moedas e o RET uma so vez. O SMF so corre o run do pai quando o filho nao mudou de
+ * estado, e os filhos nunca mudam de estado com moedas nem RET. */
+
+static void vm_goto(struct vm_lane *l, States s);
+
+/** @brief Açao run do pai: moedas e devoluçao do credito, iguais em todos os estados */
+static void session_run(void *obj)
+{
+	int ev = ((struct vm_lane *)obj)->ev;
+
+	switch (ev) {
+	case ADD1:
+	case ADD2:
+	case ADD5:
+	case ADD10:
+		if (credit_full(obj, ev)) {
+			reject_coin(obj, ev);
+		} else {
+			add_credit(obj, ev);
+			vm_goto(obj, UPDATE_CREDIT);
+		}
+		break;
+	case RET:
+		return_credit(obj, ev);
+		vm_goto(obj, MENU);
+		break;
+	default:
+		break;
+	}
+}
+
+/** @brief Compra da sessao selecionada: a primeira guarda verdadeira recusa a venda */
+static void sell(void *obj, int ev)
+{
+	if (session_started(obj, ev)) {
+		warn_started(obj, ev);
+	} else if (sold_out(obj, ev)) {
+		warn_sold_out(obj, ev);
+	} else if (not_enough_credit(obj, ev)) {
+		warn_no_credit(obj, ev);
+	} else if (no_change(obj, ev)) {
+		warn_no_change(obj, ev);
+	} else {
+		issue_ticket(obj, ev);
+		vm_goto(obj, MENU);
+	}
+}
+
+/** @brief Açao de entrada em MOVIES: apresentar o filme selecionado */
+static void movies_entry(void *obj)
+{
+	show_movie(obj, ((struct vm_lane *)obj)->ev);
+}
+
+static void menu_run(void *obj)
+{
+	int ev = ((struct vm_lane *)obj)->ev;
+
+	if (ev == UP || ev == DOWN) {
+		vm_goto(obj, MOVIES);
+	}
+}
+
+static void movies_run(void *obj)
+{
+	int ev = ((struct vm_lane *)obj)->ev;
+
+	if (ev == UP) {
+		next_movie(obj, ev);
+	} else if (ev == DOWN) {
+		prev_movie(obj, ev);
+	} else if (ev == SEL) {
+		sell(obj, ev);
+	}
+}
+
+static void credit_run(void *obj)
+{
+	int ev = ((struct vm_lane *)obj)->ev;
+
+	if (ev == UP || ev == DOWN) {
+		vm_goto(obj, MOVIES);
+	} else if (ev == SEL) {
+		if (no_movie_selected(obj, ev)) {
+			warn_no_movie(obj, ev);
+		} else {
+			sell(obj, ev);
+		}
+	}
+}
+
+/** @brief Estado pai, fora do enum States (nunca é o estado atual) */
+static const struct smf_state session_state = SMF_CREATE_STATE(NULL, session_run, NULL, NULL);
+
+/** @brief Estados filhos, indexados por States (const, ficam em flash) */
+static const struct smf_state vm_states[NUM_STATES] = {
+	[MENU]		= SMF_CREATE_STATE(NULL, menu_run, NULL, &session_state),
+	[MOVIES]	= SMF_CREATE_STATE(movies_entry, movies_run, NULL, &session_state),
+	[UPDATE_CREDIT]	= SMF_CREATE_STATE(NULL, credit_run, NULL, &session_state),
+};
+
+static States vm_state(struct vm_lane *l)
+{
+	return (States)(l->smf.current - vm_states);
+}
+
+/** @brief Muda de estado; as auto-transiçoes sao ignoradas para nao repetir a entrada */
+static void vm_goto(struct vm_lane *l, States s)
+{
+	if (vm_state(l) != s) {
+		smf_set_state(SMF_CTX(l), &vm_states[s]);
+	}
+}
+
+static void vm_dispatch(struct vm_lane *l, int ev)
+{
+	/* NONE so acorda a thread (catalogo novo, mudança de hora) */
+	if (ev <= NONE || ev >= NUM_EVENTS) {
+		return;
+	}
+	l->ev = ev;
+	smf_run_state(SMF_CTX(l));
+}
+
+static void vm_start(struct vm_lane *l, States s)
+{
+	smf_set_initial(SMF_CTX(l), &vm_states[s]);
+}
+#endif /* CONFIG_VENDING_FSM_TABLE */
+
+#ifdef CONFIG_VENDING_IDLE_STATS
+/** @brief Tempo (ciclos) em que a maquina de estados esteve bloqueada à espera de eventos */
+static uint64_t idle_cycles;
+/** @brief Inicio do periodo de mediçao atual (ciclos) */
+static uint32_t stats_start;
+
+/** @brief Imprime a percentagem de tempo em idle desde o ultimo relatorio
+ *
+ * Chamada quando passam SLEEP_TIME_MS sem eventos. Inclui a ocupaçao da fila de eventos.
 */
-static volatile char Hora[] = {19, 21, 23, 19, 21}; 
-/** @brief Lista de Preços
- * array com os preços relacionado a cada filme e sessao
+static void print_idle_stats(void)
+{
+	uint32_t now = k_cycle_get_32();
+	uint64_t total = (uint32_t)(now - stats_start);
+	uint32_t permille = total ? (uint32_t)((idle_cycles * 1000U) / total) : 1000U;
+	struct event_ring_stats ring_stats;
+	struct vm_lane *l;
+	struct buttons_isr_stats isr;
+	struct output_stats out;
+	struct change_stats chg;
+	struct catalog_swap_stats sw;
+	struct strpool_stats sp;
+	uint16_t stock[CHANGE_NUM_COINS];
+#ifdef CONFIG_VENDING_CATALOG_DELTA
+	struct catalog_delta_stats dl;
+#endif
+#ifdef CONFIG_VENDING_CATALOG_DETAILS
+	struct catalog_details_stats cd;
+#endif
+#ifdef CONFIG_VENDING_JOURNAL
+	struct journal_stats jn;
+#endif
+#ifdef CONFIG_VENDING_LOW_POWER
+	struct lowpower_stats lp;
+#endif
+
+	vm_printf("Idle: %u.%u%% de %u ms\n", permille / 10U, permille % 10U,
+		  (uint32_t)k_cyc_to_ms_floor64(total));
+	for (l = lanes; l < lanes + VM_LANES; l++) {
+		event_ring_stats_get(&l->ring, &ring_stats);
+		lane_printf(l, "Fila: eventos %u, perdidos %u, fila max %u/%u\n", ring_stats.pushed,
+			    ring_stats.overflows, ring_stats.high_water, ring_stats.capacity);
+	}
+
+	buttons_isr_stats_get(&isr);
+	vm_printf("Botoes: %u interrupcoes, %u confirmados, %u rejeitados\n", isr.calls,
+	       isr.confirmed, isr.rejected);
+#ifdef CONFIG_VENDING_ISR_TIMING
+	vm_printf("ISR botoes: media %u ciclos, max %u ciclos\n",
+	       isr.calls ? (uint32_t)(isr.total_cycles / isr.calls) : 0U, isr.max_cycles);
+#endif
+
+#ifdef CONFIG_VENDING_LOW_POWER
+	lowpower_stats_get(&lp);
+	vm_printf("Energia: %u s de %u s em baixo consumo (%u entradas, %u adiadas), ~%u.%u uA\n",
+		  lp.sleep_ms / 1000U, lp.total_ms / 1000U, lp.entries, lp.refused,
+		  lp.avg_ua_x10 / 10U, lp.avg_ua_x10 % 10U);
+	vm_printf("Energia: ~%u.%u uAh por hora sem clientes, resposta ao acordar %u us "
+		  "(%u us apos o debounce, max %u us)\n", lp.idle_hour_uah_x10 / 10U,
+		  lp.idle_hour_uah_x10 % 10U, lp.wake_edge_us, lp.wake_event_us, lp.wake_max_us);
+#endif
+
+	output_stats_get(&out);
+	vm_printf("Saida: %u bytes, %u mensagens (%u bytes) descartadas, buffer max %u/%u, %u envios\n",
+		  out.bytes, out.dropped_msgs, out.dropped_bytes, out.high_water, out.capacity,
+		  out.chunks);
+
+	change_stats_get(&chg, stock);
+	vm_printf("Troco: stock %ux10 %ux5 %ux2 %ux1, %u pagamentos, %u vendas recusadas\n",
+		  stock[0], stock[1], stock[2], stock[3], chg.payouts, chg.refused);
+	vm_printf("Troco: tabela completa %u ciclos, %u recalculos parciais (max %u ciclos)\n",
+		  chg.refresh_full, chg.refreshes, chg.refresh_max);
+
+#ifdef CONFIG_VENDING_JOURNAL
+	journal_stats_get(&jn);
+	vm_printf("Diario: %u registos, %u commits (%u bytes), %u perdidos, commit media %u us max %u us\n",
+		  jn.records, jn.commits, jn.bytes, jn.lost, jn.commit_avg_us, jn.commit_max_us);
+	if (jn.tickets) {
+		/* bytes em flash por 1000 bilhetes, incluindo a entrada de alocaçao (8 bytes) do NVS */
+		uint32_t per_k = (uint32_t)(((uint64_t)jn.bytes + jn.commits * 8U) * 1000U / jn.tickets);
+
+		vm_printf("Diario: %u bytes/1000 bilhetes (%u.%02u setores), recuperacao %u us\n", per_k,
+			  per_k / jn.sector_size, (per_k % jn.sector_size) * 100U / jn.sector_size,
+			  jn.replay_us);
+	}
+#endif
+
+	strpool_stats_get(&sp);
+	vm_printf("Titulos: %u strings, %u B flash + %u/%u B RAM, handles %u B vs %u B por sessao\n",
+		  sp.strings, sp.flash_bytes, sp.ram_bytes, sp.ram_size,
+		  (uint32_t)(catalog_count(catalog_get()) * sizeof(str_handle_t)),
+		  (uint32_t)catalog_naive_title_bytes(catalog_get()));
+
+	vm_printf("Sessoes: %u de %u por comecar as %02u:%02u, %u retiradas\n",
+		  catalog_upcoming_count(), catalog_count(catalog_get()), wallclock_minute() / 60U,
+		  wallclock_minute() % 60U, catalog_upcoming_dropped());
+
+	catalog_swap_stats_get(&sw);
+	vm_printf("Catalogo: versao %u, %u trocas, publicacao %u us, troca max %u us\n", sw.version,
+		  sw.swaps, sw.publish_us, sw.switch_max_us);
+#ifdef CONFIG_VENDING_CATALOG_DELTA
+	catalog_delta_stats_get(&dl);
+	vm_printf("Catalogo: %u incrementais (%u rejeitados), ultimo %u bytes aplicado em %u us\n",
+		  dl.applied, dl.rejected, dl.last_bytes, dl.last_apply_us);
+#endif
+#ifdef CONFIG_VENDING_CATALOG_DETAILS
+	catalog_details_stats_get(&cd);
+	vm_printf("Detalhes: %u -> %u bytes em flash, cache %u acertos %u falhas, consulta max %u us\n",
+		  cd.raw_bytes, cd.packed_bytes, cd.hits, cd.misses, cd.lookup_max_us);
+#endif
+
+	trace_dump();
+#ifdef CONFIG_VENDING_THREAD_STATS
+	/* Pilha usada e tempo de CPU de cada thread (dimensionar *_STACK_SIZE e prioridades) */
+	thread_analyzer_print();
+#endif
+
+	idle_cycles = 0;
+	stats_start = now;
+}
+#endif /* CONFIG_VENDING_IDLE_STATS */
+
+#ifdef CONFIG_VENDING_LOW_POWER
+/** @brief Nenhum painel tem um cliente: todos em MENU e sem credito */
+static bool lanes_idle(void)
+{
+	struct vm_lane *l;
+
+	for (l = lanes; l < lanes + VM_LANES; l++) {
+		if (vm_state(l) != MENU || l->credit != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+#endif
+
+/** @brief Bloqueia a maquina de estados ate chegar um evento
+ *
+ * A thread so acorda para processar uma transiçao; com CONFIG_VENDING_IDLE_STATS o tempo
+ * bloqueado é acumulado e, se nao houver eventos durante SLEEP_TIME_MS, é impresso o relatorio.
+ * Com CONFIG_VENDING_LOW_POWER, sem clientes durante CONFIG_VENDING_LOW_POWER_TIMEOUT_S a
+ * maquina entra em baixo consumo ate um botao a acordar.
 */
-static volatile int Preco[]= {9, 11, 9, 10, 12};
+static void wait_for_event(void)
+{
+	k_timeout_t timeout = IS_ENABLED(CONFIG_VENDING_IDLE_STATS) ? K_MSEC(SLEEP_TIME_MS) : K_FOREVER;
+#ifdef CONFIG_VENDING_IDLE_STATS
+	uint32_t t0 = k_cycle_get_32();
+#endif
+#ifdef CONFIG_VENDING_LOW_POWER
+	bool can_sleep = !lowpower_active() && lanes_idle();
+#endif
+	int ret __unused;
+
+#ifdef CONFIG_VENDING_LOW_POWER
+	if (can_sleep) {
+		timeout = K_SECONDS(CONFIG_VENDING_LOW_POWER_TIMEOUT_S);
+	}
+#endif
+
+	ret = k_sem_take(&ev_sem, timeout);
+#ifdef CONFIG_VENDING_IDLE_STATS
+	idle_cycles += (uint32_t)(k_cycle_get_32() - t0);
+#endif
+
+#ifdef CONFIG_VENDING_LOW_POWER
+	if (ret == 0) {
+		lowpower_exit();
+		return;
+	}
+	if (can_sleep && lowpower_enter() == 0) {
+		return;
+	}
+#endif
+#ifdef CONFIG_VENDING_IDLE_STATS
+	if (ret != 0) {
+		print_idle_stats();
+	}
+#endif
+}
 
-/** @brief variavel de identificaçao da posiçao da lista de filmes
- * Aponta para o filme selecionado e a ser apresentado no Estado movie 
+
+/** @brief Escalonador: despacha no maximo um evento de cada painel, por ordem
+ *
+ * Um painel com muitos eventos na fila (p.ex. scroll continuo) so atrasa os outros um
+ * evento por volta. Todos os paineis correm nesta thread, pelo que as guardas e açoes de
+ * um evento nunca se intercalam com as de outro painel.
+ * @return numero de eventos despachados
 */
-static volatile int movie_idx = 0;
+static int lanes_round(void)
+{
+	struct event_ring_stats ring_stats;
+	struct vm_event evt;
+	struct vm_lane *l;
+	uint32_t t_disp __unused;
+	int n = 0;
 
+	for (l = lanes; l < lanes + VM_LANES; l++) {
+		if (!event_ring_pop(&l->ring, &evt)) {
+			continue;
+		}
 
+		/* Avisar se a fila encheu desde o ultimo evento (dimensionamento da fila) */
+		event_ring_stats_get(&l->ring, &ring_stats);
+		if (ring_stats.overflows != l->overflows_seen) {
+			lane_printf(l, "Aviso: %u eventos perdidos (ocupacao maxima %u/%u)\n",
+				    ring_stats.overflows - l->overflows_seen, ring_stats.high_water,
+				    ring_stats.capacity);
+			l->overflows_seen = ring_stats.overflows;
+		}
 
-//---------------------------------------------------------
-/* Get node ID for GPIO0, which has leds and buttons */ 
-#define GPIO0_NODE DT_NODELABEL(gpio0)
+		t_disp = trace_now();
+		vm_dispatch(l, evt.ev);
+#ifdef CONFIG_VENDING_TRACE
+		trace_event(evt.ev, evt.t_isr, t_disp, trace_now());
+#endif
+		if (evt.ev != NONE) {
+			recorder_event(l->id, evt.ev, vm_state(l));
+			lowpower_response(evt.ts);
+		}
+		sim_harness_dispatched(l->id, evt.ev);
+		n++;
+	}
+	return n;
+}
+
+#ifdef CONFIG_VENDING_TEST_HOOKS
+void vm_test_prepare(States s, int credit, uint16_t movie_idx, uint8_t same_movie)
+{
+	struct vm_lane *l = &lanes[0];
+
+	/* A entrada em MOVIES (SMF) apresenta o filme; o contexto pedido é reposto a seguir */
+	vm_start(l, s);
+	l->credit = credit;
+	l->movie_idx = movie_idx;
+	l->same_movie = same_movie;
+}
+
+void vm_test_dispatch(Event ev)
+{
+	vm_dispatch(&lanes[0], ev);
+}
+
+bool vm_test_push(Event ev)
+{
+	return event_ring_push(&lanes[0].ring, ev);
+}
+
+int vm_test_run(void)
+{
+	int n = 0;
+	int k;
+
+	while ((k = lanes_round()) > 0) {
+		n += k;
+	}
+	return n;
+}
 
-/* Now get the device pointer for GPIO0 */
-static const struct device * gpio0_dev = DEVICE_DT_GET(GPIO0_NODE);
+States vm_test_state(void)
+{
+	return vm_state(&lanes[0]);
+}
 
-/* Define a variable of type static struct gpio_callback, which will latter be used to install the callback
-*  It defines e.g. which pin triggers the callback and the address of the function */
-static struct gpio_callback button_cb_data;
+int vm_test_credit(void)
+{
+	return lanes[0].credit;
+}
 
-/* Define a callback function. It is like an ISR (and runs in the cotext of an ISR) */
-/* that is called when the button is pressed */
+uint16_t vm_test_movie(void)
+{
+	return lanes[0].movie_idx;
+}
 
-/** @brief Funçao de callback com funcionamento identico a uma interrupçao
- * 
- * Funçao que é chamada quando um botao é primido e irá identificar qual botao foi primido
- * 
- * 
+void vm_test_lane_credit(uint8_t lane, int credit)
+{
+	if (lane < VM_LANES) {
+		lanes[lane].credit = credit;
+	}
+}
+#endif /* CONFIG_VENDING_TEST_HOOKS */
+
+/** @brief Thread da maquina de estados (escalonador dos paineis)
+ *
+ * Tem a prioridade mais alta da aplicaçao (CONFIG_VENDING_FSM_PRIORITY): a saida de texto
+ * e as escritas do diario correm em threads de prioridade inferior e so recebem trabalho
+ * por filas limitadas, pelo que uma UART ou uma flash lentas nao atrasam o credito das
+ * moedas. Criada parada e iniciada por main() depois da inicializaçao.
 */
-void button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
-{
-	int i=0;
-	/** Identify the button(s) that was(ere) hit*/
-	for(i=0; i<sizeof(buttons_pins); i++){		
-		if(BIT(buttons_pins[i]) & pins) {
-			/* add 1 euro*/
-			if(i==0){
-				eventos = ADD1;
-			}
-			/* add 2 euro*/
-			else if(i==1){
-				eventos = ADD2;
-			}
-			/* add 5 euro*/
-			else if(i==2){
-				eventos = ADD5;
-			}
-			/* add 10 euro*/
-			else if(i==3){
-				eventos = ADD10;
-			}
-			/* Up */
-			else if(i==4){
-				eventos = UP;
-			}
-			/* Down */
-			else if(i==5){
-				eventos = DOWN;
-			}
-			/* Pay check*/
-			else if(i==6){
-				eventos = SEL;
-			}
-			/* Return */
-			else if(i==7){
-				eventos = RET;
-			}
-			else{
-				eventos = NONE;
-			}
+static void fsm_thread(void *p1, void *p2, void *p3)
+{
+	while(1){
+		/* Versao nova do catalogo: so é adotada aqui, entre dois eventos */
+		if(catalog_sync()){
+			catalog_changed();
 		}
-	} 
+		/* Retirar da vista as sessoes que começaram (so trabalha quando muda a hora) */
+		catalog_upcoming_update(wallclock_hour());
+
+		/* Filas vazias: bloquear ate a callback dos botoes dar o semaforo */
+		if(lanes_round() == 0){
+			wait_for_event();
+		}
+	}
 }
 
+K_THREAD_DEFINE(vm_fsm, CONFIG_VENDING_FSM_STACK_SIZE, fsm_thread, NULL, NULL, NULL,
+		CONFIG_VENDING_FSM_PRIORITY, 0, SYS_FOREVER_MS);
 
-void main(void)
+int vm_init(void)
 {
-    int i,ret;
-    uint32_t pinmask = 0; /* Mask for setting the pins that shall generate interrupts */
-
-	/*Configure the GPIO pins - buttons 1-4 + IOPINS 2,4,28 and 29 for input*/
-	/** @brief Configuraçao dos pinos de entrada
-	 * 
-	 * Os pinos usados para utilizar os butoes têm de ser configurados como entradas
-	*/
-    for(i=0; i<sizeof(buttons_pins); i++) {
-		ret = gpio_pin_configure(gpio0_dev, buttons_pins[i], GPIO_INPUT | GPIO_PULL_UP);
-		if (ret < 0) {
-			printk("Error: gpio_pin_configure failed for button %d/pin %d, error:%d\n\r", i+1,buttons_pins[i], ret);
-			return;
-		} else {
-			printk("Success: gpio_pin_configure for button %d/pin %d\n\r", i+1,buttons_pins[i]);
-		}
+    int ret;
+	int i;
+	struct event_ring *rings[VM_LANES];
+#ifdef CONFIG_VENDING_JOURNAL
+	int balance[VM_LANES];
+#endif
+
+	for (i = 0; i < VM_LANES; i++) {
+		lanes[i].id = i;
+		lanes[i].same_movie = 1;
+		event_ring_init(&lanes[i].ring);
+		rings[i] = &lanes[i].ring;
 	}
+	trace_init();
+	lowpower_init();
+
+	/* Saida das mensagens da maquina de estados por DMA ou pela thread de saida */
+	output_init();
 
-    /* Configure the interrupt on the button's pin */
-	/** @brief ativaçao de interrupçoes no pinos usados pelos butoes
-	 * 
-	 * Ativar o modo de interrupçao para os pinos relacionados com os butoes
-	*/
-	for(i=0; i<sizeof(buttons_pins); i++) {
-		ret = gpio_pin_interrupt_configure(gpio0_dev, buttons_pins[i], GPIO_INT_EDGE_TO_ACTIVE );
-		if (ret < 0) {
-			printk("Error: gpio_pin_interrupt_configure failed for button %d / pin %d, error:%d", i+1, buttons_pins[i], ret);
-			return;
+	/* Stock inicial dos tubos de troco */
+	change_init();
+
+#ifdef CONFIG_VENDING_JOURNAL
+	/* Recuperar o credito de cada painel registado antes de uma falha de energia */
+	if (journal_init(balance, VM_LANES) == 0) {
+		for (i = 0; i < VM_LANES; i++) {
+			lanes[i].credit = balance[i];
+			if (balance[i] > 0) {
+				lane_printf(&lanes[i], "Credito recuperado: %d EUR\n", balance[i]);
+			}
 		}
 	}
-    
-    /* Initialize the static struct gpio_callback variable   */
-	pinmask=0;
-	for(i=0; i<sizeof(buttons_pins); i++) {
-		pinmask |= BIT(buttons_pins[i]);
-	}
-    gpio_init_callback(&button_cb_data, button_pressed, pinmask); 	
-	
-	/* Add the callback function by calling gpio_add_callback()   */
-	gpio_add_callback(gpio0_dev, &button_cb_data);
-
-    while(1){
-
-        switch(estado){
-            case MENU:
-				if (eventos == ADD1 || eventos == ADD2 || eventos == ADD5 || eventos == ADD10){
-					estado = UPDATE_CREDIT;
-				}
-				else if(eventos == RET){
-					printk("%d EUR return\n",Credito);
-					Credito = 0;
-					eventos = NONE;
-				}
-				else if(eventos == UP || eventos == DOWN){
-					estado = MOVIES;
-					same_movie = 1;
-				}
-				// else if(eventos == SEL){}
-				break;
-
-			case UPDATE_CREDIT:
-				
-				// Eventos que fazem a mudança de estado
-				// retornar o credito
-				if(eventos == RET){
-					printk("%d EUR return\n",Credito);
-					Credito = 0;
-					eventos = NONE;
-					estado = MENU;
-					break;
-				}
-				// Fazer pesquisa na lista de filmes
-				if(eventos == UP || eventos == DOWN){
-					same_movie = 1; // apresenta o filme selecionado ou o primeiro da lista
-					estado = MOVIES;
-					eventos = NONE;
-					break;
-				}
-				/*verificar se temos algum filme selecionado */
-				if(eventos == SEL && same_movie == 1){
-					printk("Ainda não selecionou filme\n");
-					eventos = NONE;
-				}
-				/* se tivermos um filme selecionado e o credito menor que o preço do mesmo ficamos neste estado e imprimimos uma mensagem */
-				/* para saber que o um filme essta selecionado verificamos a variavel same_movie se esta tiver o valor 0 quer dizer que já 
-				passamos pelo menos uma vez pelo estado MOVIE */
-				else if(eventos == SEL && same_movie == 0 && Credito < Preco[movie_idx]){
-					printk("Not enough Credit. Ticket not issued!\n");
-					eventos = NONE;
-				}
-				/* se tiver filme selecionado e credito suficiente coltamos ao estado menu e necessitamos de escolher novamente um filme*/
-				else if(eventos == SEL && same_movie == 0 && Credito >= Preco[movie_idx]){
-					printk("Ticket for movie %c, session %c issued!\n",Movie[movie_idx],Hora[movie_idx]);
-					Credito = Credito - Preco[movie_idx];
-					printk("Remaining credit %d \n",Credito);
-					same_movie = 1;
-					estado = MENU;
-					eventos = NONE;
-					break;
-				}
-
-				// açoes dentro deste estado 
-				// atualizaçao do credito consoante a quantia inserida
-				
-				if (eventos == ADD1){
-					Credito += 1;
-					printk("Credito Atual: %d EUR\n\r",Credito);
-					eventos = NONE;
-				}
-				else if (eventos == ADD2){
-					Credito += 2;
-					printk("Credito Atual: %d EUR\n\r",Credito);
-					eventos = NONE;
-				}
-				else if (eventos == ADD5){
-					Credito += 5;
-					printk("Credito Atual: %d EUR\n\r",Credito);
-					eventos = NONE;
-				}
-				else if (eventos == ADD10){
-					Credito += 10;
-					printk("Credito Atual: %d EUR\n\r",Credito);
-					eventos = NONE;
-				}
-				break;
-
-			case MOVIES:
-				/* Eventos que fazem mudar deee estado */
-				/* inserir coins passa ao estado UPDATE_CREDIT */
-				if (eventos == ADD1 || eventos == ADD2 || eventos == ADD5 || eventos == ADD10){
-					estado = UPDATE_CREDIT;
-					break;
-				}
-
-				/* Returno do credito passa ao estado MENU */
-				if (eventos == RET){
-					printk("%d EUR return\n",Credito);
-					Credito = 0;
-					eventos = NONE;
-					estado = MENU;
-					break;
-				}
-
-				/* Selecionar a compra de um filme */
-				if(eventos == SEL  && Credito < Preco[movie_idx]){
-					printk("Not enough Credit. Ticket not issued!\n");
-					eventos = NONE;
-				}
-				/* se tiver filme selecionado e credito suficiente coltamos ao estado menu e necessitamos de escolher novamente um filme*/
-				else if(eventos == SEL  && Credito >= Preco[movie_idx]){
-					printk("Ticket for movie %c, session %c issued!\n",Movie[movie_idx],Hora[movie_idx]);
-					Credito = Credito - Preco[movie_idx];
-					printk("Remaining credit %d \n",Credito);
-					
-					estado = MENU;
-					eventos = NONE;
-					same_movie = 1;
-					break;
-				}
-
-				/* Açoes neste estado*/
-				/* Manter o movie_idx */
-				if(same_movie == 1){
-					printk("Movie %c, %dH00 session \n", Movie[movie_idx],Hora[movie_idx]);
-					printk("Custo: %d EUR\n", Preco[movie_idx]);
-					printk("Saldo: %d EUR\n",Credito);
-					eventos = NONE;
-					same_movie = 0;
-				}
-				/* alterar movie idx*/
-				else{
-					if(eventos == UP){
-						movie_idx = (movie_idx+1)%(num_movie);
-						printk("Movie %c, %dH00 session \n", Movie[movie_idx],Hora[movie_idx]);
-						printk("Custo: %d EUR\n", Preco[movie_idx]);
-						printk("Saldo: %d EUR\n",Credito);
-						eventos = NONE;
-					}
-					else if(eventos == DOWN){
-						movie_idx = (movie_idx-1);
-						if(movie_idx < 0){
-							movie_idx = num_movie-1;
-						}
-						printk("Movie %c, %dH00 session \n", Movie[movie_idx],Hora[movie_idx]);
-						printk("Custo: %d EUR\n", Preco[movie_idx]);
-						printk("Saldo: %d EUR\n",Credito);	
-						eventos = NONE;
-					}
-				}
-				break;
-        }
-    }
-}
\ No newline at end of file
+#endif
+
+	ret = catalog_init();
+	if (ret < 0) {
+		return ret;
+	}
+	/* Todas as sessoes começam com a sala vazia */
+	seats_init(catalog_get());
+
+	/* Catalogos novos recebidos pela UART (ou de ficheiro em native_posix) */
+	catalog_loader_init(&lanes[0].ring, &ev_sem);
+
+	/* Hora do dia e timer do inicio de cada hora */
+	wallclock_init(&lanes[0].ring, &ev_sem);
+
+	/* Configurar os botoes e instalar as callbacks que colocam os eventos na fila de cada painel */
+	ret = buttons_init(rings, &ev_sem);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Reproduçao de uma gravaçao (native_posix, -replay=<ficheiro>) pelas mesmas filas */
+	recorder_replay_init(rings, &ev_sem);
+
+#ifdef CONFIG_VENDING_IDLE_STATS
+	stats_start = k_cycle_get_32();
+#endif
+
+	for (i = 0; i < VM_LANES; i++) {
+		vm_start(&lanes[i], MENU);
+	}
+	return 0;
+}
+
+/* Com ZTEST o main() é o da suite de testes (tests/vending), que chama vm_init() */
+#ifndef CONFIG_ZTEST
+void main(void)
+{
+	if (vm_init() < 0) {
+		return;
+	}
+
+#ifdef CONFIG_VENDING_FSM_BENCH
+	fsm_bench_run();
+#endif
+#ifdef CONFIG_VENDING_WCET
+	/* Usa o painel 0, os lugares e o troco reais; deixa-os no estado inicial */
+	fsm_wcet_run();
+#endif
+
+	/* A partir daqui a maquina de estados corre na sua thread; main() termina */
+	k_thread_start(vm_fsm);
+	sim_harness_ready();
+	recorder_replay_ready();
+	catalog_file_ready();
+}
+#endif /* CONFIG_ZTEST */
@@ -0,0 +1,453 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file output.c
+* \brief Saida de texto por buffer circular, esvaziado pela UARTE com DMA ou por uma thread
+* de baixa prioridade (ver output.h)
+*/
+
+#include <zephyr.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/fatal.h>
+
+#include "output.h"
+#include "trace.h"
+
+#if defined(CONFIG_VENDING_ASYNC_OUTPUT) || defined(CONFIG_VENDING_OUTPUT_THREAD)
+
+#include <zephyr/sys/ring_buffer.h>
+
+/** @brief Tamanho maximo de uma mensagem formatada */
+#define OUTPUT_MSG_MAX 128
+
+/** @brief Buffer circular com o texto à espera de ser enviado */
+RING_BUF_DECLARE(out_ring, CONFIG_VENDING_OUTPUT_BUF_SIZE);
+
+static struct k_spinlock out_lock;
+static bool out_ready;
+static struct output_stats stats;
+/** @brief Total de bytes enviados pela UART */
+static uint32_t sent_total;
+
+static void output_kick(void);
+
+#endif
+
+#ifdef CONFIG_VENDING_ASYNC_OUTPUT
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/pm/device.h>
+
+static const struct device *uart_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+
+/** @brief Bytes do buffer que estao a ser enviados por DMA (0 = UART livre) */
+static uint32_t tx_len;
+/** @brief UART suspensa (output_suspend()): o texto fica no buffer ate output_resume() */
+static bool out_suspended;
+/** @brief Dado pela callback quando a receçao termina em output_suspend() */
+static K_SEM_DEFINE(rx_off, 0, 1);
+
+/** @brief Espera (ms) antes de voltar a tentar um envio recusado pela UART */
+#define OUTPUT_RETRY_MS 1
+
+static void output_retry(struct k_work *work);
+/** @brief Nova tentativa de envio depois de uart_tx() recusar o bloco */
+static K_WORK_DELAYABLE_DEFINE(retry_work, output_retry);
+
+/** @brief Tamanho de cada buffer de receçao */
+#define OUTPUT_RX_BUF_SIZE 32
+/** @brief Tempo sem bytes (us) ao fim do qual os bytes recebidos sao entregues */
+#define OUTPUT_RX_TIMEOUT_US 10000
+
+/** @brief Dois buffers de receçao: o driver enche um enquanto o outro é entregue */
+static uint8_t rx_buf[2][OUTPUT_RX_BUF_SIZE];
+static uint8_t rx_next;
+static output_rx_cb_t rx_cb;
+
+/** @brief Inicia a transferencia DMA do proximo bloco contiguo do buffer
+ * Chamada com out_lock adquirido. */
+static void output_kick(void)
+{
+	uint8_t *data;
+	uint32_t len;
+
+	if (tx_len != 0 || out_suspended) {
+		return;
+	}
+	len = ring_buf_get_claim(&out_ring, &data, CONFIG_VENDING_OUTPUT_BUF_SIZE);
+	if (len == 0) {
+		return;
+	}
+	if (uart_tx(uart_dev, data, len, SYS_FOREVER_US) == 0) {
+		tx_len = len;
+		stats.chunks++;
+	} else {
+		/* UART ocupada (ex.: printk em curso): tentar de novo daqui a pouco, sem esperar
+		 * pela mensagem seguinte, que pode nunca chegar */
+		ring_buf_get_finish(&out_ring, 0);
+		k_work_schedule(&retry_work, K_MSEC(OUTPUT_RETRY_MS));
+	}
+}
+
+static void output_retry(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&out_lock);
+
+	output_kick();
+	k_spin_unlock(&out_lock, key);
+}
+
+static void output_uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	k_spinlock_key_t key;
+
+	switch (evt->type) {
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		key = k_spin_lock(&out_lock);
+		ring_buf_get_finish(&out_ring, tx_len);
+		sent_total += tx_len;
+		tx_len = 0;
+		output_kick();
+		k_spin_unlock(&out_lock, key);
+		trace_output_sent(sent_total);
+		break;
+	case UART_RX_RDY:
+		rx_cb(evt->data.rx.buf + evt->data.rx.offset, evt->data.rx.len);
+		break;
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, rx_buf[rx_next], OUTPUT_RX_BUF_SIZE);
+		rx_next ^= 1U;
+		break;
+	case UART_RX_DISABLED:
+		if (out_suspended) {
+			k_sem_give(&rx_off);
+			break;
+		}
+		/* ex.: erro de framing; voltar a receber */
+		rx_next = 1U;
+		uart_rx_enable(dev, rx_buf[0], OUTPUT_RX_BUF_SIZE, OUTPUT_RX_TIMEOUT_US);
+		break;
+	default:
+		break;
+	}
+}
+
+int output_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(uart_dev)) {
+		return -ENODEV;
+	}
+	ret = uart_callback_set(uart_dev, output_uart_cb, NULL);
+	if (ret < 0) {
+		printk("Error: uart_callback_set failed, error:%d (saida por printk)\n", ret);
+		return ret;
+	}
+	stats.capacity = CONFIG_VENDING_OUTPUT_BUF_SIZE;
+	out_ready = true;
+	return 0;
+}
+
+int output_rx_enable(output_rx_cb_t cb)
+{
+	if (!out_ready) {
+		return -ENODEV;
+	}
+	rx_cb = cb;
+	rx_next = 1U;
+	return uart_rx_enable(uart_dev, rx_buf[0], OUTPUT_RX_BUF_SIZE, OUTPUT_RX_TIMEOUT_US);
+}
+
+void output_flush_panic(void)
+{
+	uint8_t c;
+
+	if (!out_ready) {
+		return;
+	}
+	out_ready = false;
+	uart_tx_abort(uart_dev);
+	/* O bloco em DMA pode ja ter sido parcialmente enviado; reenviar tudo por polling */
+	ring_buf_get_finish(&out_ring, 0);
+	while (ring_buf_get(&out_ring, &c, 1) == 1) {
+		uart_poll_out(uart_dev, c);
+	}
+}
+
+#ifdef CONFIG_VENDING_LOW_POWER
+
+/** @brief Espera maxima pelo fim do envio e da receçao antes de suspender (ms) */
+#define OUTPUT_SUSPEND_WAIT_MS 100
+
+int output_suspend(void)
+{
+	k_spinlock_key_t key;
+	bool busy = true;
+	int i;
+
+	if (!out_ready) {
+		return 0;
+	}
+	/* Esperar que o buffer esvazie: um bloco em DMA impede a suspensao da UARTE */
+	for (i = 0; busy && i < OUTPUT_SUSPEND_WAIT_MS; i++) {
+		key = k_spin_lock(&out_lock);
+		busy = tx_len != 0 || !ring_buf_is_empty(&out_ring);
+		if (!busy) {
+			out_suspended = true;
+		}
+		k_spin_unlock(&out_lock, key);
+		if (busy) {
+			k_sleep(K_MSEC(1));
+		}
+	}
+	if (busy) {
+		return -EBUSY;
+	}
+	if (rx_cb != NULL && uart_rx_disable(uart_dev) == 0) {
+		k_sem_take(&rx_off, K_MSEC(OUTPUT_SUSPEND_WAIT_MS));
+	}
+	/* Sem CONFIG_PM_DEVICE no driver fica pelo menos a receçao parada */
+	(void)pm_device_action_run(uart_dev, PM_DEVICE_ACTION_SUSPEND);
+	return 0;
+}
+
+void output_resume(void)
+{
+	k_spinlock_key_t key;
+
+	if (!out_ready || !out_suspended) {
+		return;
+	}
+	(void)pm_device_action_run(uart_dev, PM_DEVICE_ACTION_RESUME);
+	if (rx_cb != NULL) {
+		rx_next = 1U;
+		uart_rx_enable(uart_dev, rx_buf[0], OUTPUT_RX_BUF_SIZE, OUTPUT_RX_TIMEOUT_US);
+	}
+	/* Enviar o que foi escrito durante a suspensao (ex.: relatorio de idle) */
+	key = k_spin_lock(&out_lock);
+	out_suspended = false;
+	output_kick();
+	k_spin_unlock(&out_lock, key);
+}
+
+#endif /* CONFIG_VENDING_LOW_POWER */
+
+#elif defined(CONFIG_VENDING_OUTPUT_THREAD)
+
+/** @brief Acorda a thread de saida quando ha texto novo no buffer */
+static K_SEM_DEFINE(out_sem, 0, 1);
+
+/** @brief Chamada com out_lock adquirido (a thread envia fora do lock) */
+static void output_kick(void)
+{
+	k_sem_give(&out_sem);
+}
+
+/** @brief Thread de saida: envia o buffer por printk, abaixo da prioridade da maquina de
+ * estados, que so é atrasada pela copia da mensagem para o buffer */
+static void output_thread(void *p1, void *p2, void *p3)
+{
+	k_spinlock_key_t key;
+	uint8_t *data;
+	uint32_t len;
+
+	while (1) {
+		k_sem_take(&out_sem, K_FOREVER);
+		while (1) {
+			/* o bloco reclamado nao é tocado por vm_printf(), que so escreve no espaço livre */
+			key = k_spin_lock(&out_lock);
+			len = ring_buf_get_claim(&out_ring, &data, CONFIG_VENDING_OUTPUT_BUF_SIZE);
+			k_spin_unlock(&out_lock, key);
+			if (len == 0) {
+				break;
+			}
+			printk("%.*s", (int)len, data);
+
+			key = k_spin_lock(&out_lock);
+			ring_buf_get_finish(&out_ring, len);
+			sent_total += len;
+			stats.chunks++;
+			k_spin_unlock(&out_lock, key);
+			trace_output_sent(sent_total);
+		}
+	}
+}
+
+K_THREAD_DEFINE(vm_output, CONFIG_VENDING_OUTPUT_STACK_SIZE, output_thread, NULL, NULL, NULL,
+		CONFIG_VENDING_OUTPUT_PRIORITY, 0, 0);
+
+int output_init(void)
+{
+	stats.capacity = CONFIG_VENDING_OUTPUT_BUF_SIZE;
+	out_ready = true;
+	return 0;
+}
+
+int output_rx_enable(output_rx_cb_t cb)
+{
+	return -ENOTSUP;
+}
+
+void output_flush_panic(void)
+{
+	uint8_t c;
+
+	if (!out_ready) {
+		return;
+	}
+	out_ready = false;
+	/* Um bloco a meio de printk na thread de saida pode sair repetido */
+	ring_buf_get_finish(&out_ring, 0);
+	while (ring_buf_get(&out_ring, &c, 1) == 1) {
+		printk("%c", c);
+	}
+}
+
+#endif /* CONFIG_VENDING_OUTPUT_THREAD */
+
+#if !defined(CONFIG_VENDING_ASYNC_OUTPUT) && defined(CONFIG_VENDING_LOW_POWER)
+
+/* Sem receçao assincrona a UART so esta ativa durante o envio por polling */
+int output_suspend(void)
+{
+	return 0;
+}
+
+void output_resume(void)
+{
+}
+
+#endif
+
+#if defined(CONFIG_VENDING_ASYNC_OUTPUT) || defined(CONFIG_VENDING_OUTPUT_THREAD)
+
+void vm_printf(const char *fmt, ...)
+{
+	char msg[OUTPUT_MSG_MAX];
+	k_spinlock_key_t key;
+	va_list ap;
+	int len;
+	uint32_t used;
+
+	va_start(ap, fmt);
+	if (!out_ready) {
+		vprintk(fmt, ap);
+		va_end(ap);
+		return;
+	}
+	len = vsnprintk(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	len = MIN(len, (int)sizeof(msg) - 1);
+	if (len <= 0) {
+		return;
+	}
+
+	key = k_spin_lock(&out_lock);
+	if (ring_buf_space_get(&out_ring) < (uint32_t)len) {
+		/* back-pressure: descartar a mensagem inteira em vez de bloquear */
+		stats.dropped_msgs++;
+		stats.dropped_bytes += len;
+	} else {
+		ring_buf_put(&out_ring, (const uint8_t *)msg, len);
+		stats.bytes += len;
+		used = CONFIG_VENDING_OUTPUT_BUF_SIZE - ring_buf_space_get(&out_ring);
+		if (used > stats.high_water) {
+			stats.high_water = used;
+		}
+		output_kick();
+	}
+	k_spin_unlock(&out_lock, key);
+}
+
+uint32_t output_queued_bytes(void)
+{
+	return stats.bytes;
+}
+
+int output_flush(int timeout_ms)
+{
+	k_spinlock_key_t key;
+	bool pending;
+
+	while (out_ready) {
+		/* o espaço livre so volta quando o envio termina (ring_buf_get_finish) */
+		key = k_spin_lock(&out_lock);
+		pending = ring_buf_space_get(&out_ring) != CONFIG_VENDING_OUTPUT_BUF_SIZE;
+		k_spin_unlock(&out_lock, key);
+		if (!pending) {
+			break;
+		}
+		if (timeout_ms-- <= 0) {
+			return -EAGAIN;
+		}
+		k_sleep(K_MSEC(1));
+	}
+	return 0;
+}
+
+void output_stats_get(struct output_stats *st)
+{
+	k_spinlock_key_t key = k_spin_lock(&out_lock);
+
+	*st = stats;
+	k_spin_unlock(&out_lock, key);
+}
+
+#ifdef CONFIG_VENDING_OUTPUT_FATAL_FLUSH
+/** @brief Tratamento de erros fatais: esvaziar o buffer de saida antes de parar */
+void k_sys_fatal_error_handler(unsigned int reason, const z_arch_esf_t *esf)
+{
+	ARG_UNUSED(esf);
+
+	output_flush_panic();
+	printk("Erro fatal %u\n", reason);
+	k_fatal_halt(reason);
+}
+#endif
+
+#else /* sem buffer de saida */
+
+int output_init(void)
+{
+	return 0;
+}
+
+int output_rx_enable(output_rx_cb_t cb)
+{
+	return -ENOTSUP;
+}
+
+void vm_printf(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintk(fmt, ap);
+	va_end(ap);
+}
+
+void output_flush_panic(void)
+{
+}
+
+uint32_t output_queued_bytes(void)
+{
+	return 0;
+}
+
+int output_flush(int timeout_ms)
+{
+	return 0;
+}
+
+void output_stats_get(struct output_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+#endif /* CONFIG_VENDING_ASYNC_OUTPUT || CONFIG_VENDING_OUTPUT_THREAD */
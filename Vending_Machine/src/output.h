@@ -0,0 +1,67 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file output.h
+* \brief Saida de texto da maquina de estados sem bloquear à velocidade da UART
+*
+* Com CONFIG_VENDING_ASYNC_OUTPUT as mensagens sao formatadas para um buffer circular e
+* enviadas em segundo plano pela UARTE (EasyDMA, API assincrona da UART); com
+* CONFIG_VENDING_OUTPUT_THREAD o mesmo buffer é esvaziado por printk numa thread de
+* prioridade inferior à da maquina de estados. Se o buffer estiver cheio a mensagem é
+* descartada e contabilizada, nunca bloqueia quem escreve. Sem nenhuma das opçoes
+* vm_printf() é equivalente a printk().
+*/
+
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+#include <zephyr.h>
+
+/** @brief Estatisticas do buffer de saida (back-pressure) */
+struct output_stats {
+	uint32_t bytes;		/**< bytes aceites no buffer */
+	uint32_t dropped_msgs;	/**< mensagens descartadas por falta de espaço */
+	uint32_t dropped_bytes;	/**< bytes dessas mensagens */
+	uint32_t high_water;	/**< ocupaçao maxima do buffer (bytes) */
+	uint32_t capacity;	/**< tamanho do buffer (bytes) */
+	uint32_t chunks;	/**< blocos contiguos enviados (transferencias DMA ou printk da thread) */
+};
+
+/** @brief Prepara a UART para envio assincrono ou ativa a thread de saida
+ * @return 0 ou erro do driver (nesse caso a saida continua por printk) */
+int output_init(void);
+
+/** @brief Funçao que recebe os bytes lidos da UART (chamada na ISR da UART) */
+typedef size_t (*output_rx_cb_t)(const uint8_t *data, size_t len);
+
+/** @brief Ativa a receçao assincrona na UART da saida e entrega os bytes a cb
+ * @return 0, -ENOTSUP sem CONFIG_VENDING_ASYNC_OUTPUT ou erro do driver */
+int output_rx_enable(output_rx_cb_t cb);
+
+/** @brief Escreve uma mensagem formatada (mesma sintaxe que printk) */
+void vm_printf(const char *fmt, ...);
+
+/** @brief Baixo consumo: espera que o buffer esvazie, para a receçao e suspende a UART
+ * O texto escrito a seguir fica no buffer ate output_resume().
+ * @return 0 ou -EBUSY se o buffer nao esvaziou a tempo */
+int output_suspend(void);
+
+/** @brief Volta a ligar a UART e a receçao e envia o texto pendente */
+void output_resume(void);
+
+/** @brief Envia de imediato (por polling) tudo o que ainda esta no buffer
+ * usado no tratamento de erros fatais, quando as interrupçoes ja nao sao atendidas */
+void output_flush_panic(void);
+
+/** @brief Espera que todo o texto do buffer tenha sido enviado
+ * @return 0 ou -EAGAIN se ao fim de timeout_ms ainda houver texto por enviar */
+int output_flush(int timeout_ms);
+
+/** @brief Total de bytes aceites no buffer desde o arranque (marca para o trace) */
+uint32_t output_queued_bytes(void);
+
+/** @brief Le as estatisticas do buffer de saida */
+void output_stats_get(struct output_stats *st);
+
+#endif /* OUTPUT_H_ */
@@ -0,0 +1,145 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file recorder.c
+* \brief Gravador de eventos num anel em RAM (ver recorder.h)
+*
+* O anel sobrepoe os registos mais antigos: fica sempre o fim da sequencia que levou ao
+* problema. Escrever um registo custa um spinlock e uma copia de 12 bytes, pelo que pode
+* ser chamado na callback dos botoes.
+*/
+
+#include <zephyr.h>
+#include <zephyr/sys/printk.h>
+
+#include "recorder.h"
+#include "wallclock.h"
+
+#define REC_ENTRIES CONFIG_VENDING_RECORDER_ENTRIES
+#define REC_MASK (REC_ENTRIES - 1)
+
+BUILD_ASSERT((REC_ENTRIES & REC_MASK) == 0, "CONFIG_VENDING_RECORDER_ENTRIES must be a power of 2");
+
+static struct rec_entry ring[REC_ENTRIES];
+/** @brief Registos escritos desde o arranque (o proximo vai para ring[head & REC_MASK]) */
+static uint32_t head;
+static struct k_spinlock rec_lock;
+/** @brief Gravaçao suspensa durante recorder_dump() */
+static bool dumping;
+/** @brief Instante (us desde o arranque) do registo mais recente */
+static uint64_t last_us;
+
+/** @brief Instante atual: us desde o arranque, a partir dos ticks de 64 bits */
+static uint64_t rec_now(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/** @brief Codifica um intervalo: us abaixo de 2^31 us, senao ms (satura ao fim de ~24 dias) */
+static uint32_t rec_dt(uint64_t us)
+{
+	if (us < REC_DT_MS) {
+		return (uint32_t)us;
+	}
+	return REC_DT_MS | (uint32_t)MIN(us / USEC_PER_MSEC, (uint64_t)(REC_DT_MS - 1U));
+}
+
+static void rec_put(uint8_t kind, uint8_t lane, uint32_t arg, uint8_t ev, uint8_t state)
+{
+	k_spinlock_key_t key = k_spin_lock(&rec_lock);
+	struct rec_entry *e;
+	uint64_t now;
+
+	if (!dumping) {
+		now = rec_now();
+		e = &ring[head & REC_MASK];
+		e->dt = rec_dt(now - last_us);
+		last_us = now;
+		e->arg = arg;
+		e->kind = kind;
+		e->lane = lane;
+		e->ev = ev;
+		e->state = state;
+		head++;
+	}
+	k_spin_unlock(&rec_lock, key);
+}
+
+void recorder_edge(uint8_t port, uint32_t pins)
+{
+	rec_put(REC_EDGE, port, pins, NONE, 0);
+}
+
+void recorder_event(uint8_t lane, Event ev, uint8_t state)
+{
+	rec_put(REC_EVENT, lane, 0, ev, state);
+	recorder_replay_check(lane, ev, state);
+}
+
+void recorder_clock(uint16_t minute_of_day)
+{
+	rec_put(REC_CLOCK, 0, minute_of_day, NONE, 0);
+}
+
+/** @brief Imprime um registo como 24 digitos hexadecimais (bytes pela ordem da memoria) */
+static void rec_print(const struct rec_entry *e)
+{
+	const uint8_t *b = (const uint8_t *)e;
+	size_t k;
+
+	printk("REC ");
+	for (k = 0; k < sizeof(*e); k++) {
+		printk("%02x", b[k]);
+	}
+	printk("\n");
+}
+
+void recorder_dump(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&rec_lock);
+	uint32_t end = head;
+	uint32_t i = end > REC_ENTRIES ? end - REC_ENTRIES : 0;
+	uint64_t t_first = last_us;
+	struct rec_entry first;
+	uint32_t j;
+
+	dumping = true;
+	k_spin_unlock(&rec_lock, key);
+
+	/* Instante do registo mais antigo: o do mais recente menos os intervalos seguintes */
+	for (j = i + 1; j < end; j++) {
+		t_first -= rec_dt_us(&ring[j & REC_MASK]);
+	}
+
+	printk("REC BEGIN %u %u\n", end - i + IS_ENABLED(CONFIG_VENDING_WALLCLOCK), VM_LANES);
+#ifdef CONFIG_VENDING_WALLCLOCK
+	/* O acerto inicial da hora pode ja ter sido sobreposto: começar com a hora do dia no
+	 * instante do registo mais antigo, calculada a partir da hora atual */
+	{
+		struct rec_entry clk = { .kind = REC_CLOCK, .dt = 0 };
+		uint64_t now = rec_now();
+		uint32_t ago_min;
+
+		ago_min = (uint32_t)((now - (end != i ? t_first : now)) / (60U * USEC_PER_SEC));
+		clk.arg = (wallclock_minute() + WALLCLOCK_DAY_MIN - ago_min % WALLCLOCK_DAY_MIN) %
+			  WALLCLOCK_DAY_MIN;
+		rec_print(&clk);
+	}
+#endif
+	if (i != end) {
+		/* O intervalo do mais antigo é relativo a um registo ja sobreposto */
+		first = ring[i & REC_MASK];
+		first.dt = 0;
+		rec_print(&first);
+		i++;
+	}
+	for (; i != end; i++) {
+		rec_print(&ring[i & REC_MASK]);
+	}
+	printk("REC END\n");
+
+	key = k_spin_lock(&rec_lock);
+	dumping = false;
+	k_spin_unlock(&rec_lock, key);
+}
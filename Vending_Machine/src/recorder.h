@@ -0,0 +1,112 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file recorder.h
+* \brief Gravador de eventos (flancos dos botoes e eventos despachados) e reproduçao
+*
+* Com CONFIG_VENDING_RECORDER cada flanco que chega a button_pressed() e cada evento
+* despachado pela maquina de estados ficam num anel em RAM de registos binarios de 12 bytes.
+* O anel guarda os CONFIG_VENDING_RECORDER_ENTRIES registos mais recentes e é impresso em
+* hexadecimal pela linha "DUMP" do carregador do catalogo; scripts/rec_extract.py converte
+* o registo da consola num ficheiro que a build native_posix reproduz com -replay=<ficheiro>
+* (CONFIG_VENDING_REPLAY).
+*/
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <zephyr.h>
+
+#include "vending.h"
+#include "event_ring.h"
+
+/** @brief Tipos de registo */
+enum rec_kind {
+	REC_EDGE = 1,	/**< flanco na callback dos botoes (antes do debounce) */
+	REC_EVENT,	/**< evento despachado pela maquina de estados */
+	REC_CLOCK,	/**< acerto da hora do dia */
+};
+
+/** @brief rec_entry.dt em ms em vez de us (intervalo de 2^31 us ou mais, ~36 minutos) */
+#define REC_DT_MS BIT(31)
+
+/** @brief Registo do gravador (12 bytes, little-endian no ficheiro)
+ * O instante é guardado como intervalo desde o registo anterior, pelo que nao da a volta:
+ * o gravador guarda o instante de 64 bits do registo mais recente e a reproduçao soma os
+ * intervalos. O primeiro registo de uma impressao tem sempre intervalo 0 */
+struct rec_entry {
+	uint32_t dt;	/**< intervalo desde o registo anterior: us, ou ms com REC_DT_MS */
+	uint32_t arg;	/**< REC_EDGE: mascara de pinos; REC_CLOCK: minuto do dia */
+	uint8_t kind;	/**< enum rec_kind */
+	uint8_t lane;	/**< REC_EDGE: porta GPIO; REC_EVENT: painel */
+	uint8_t ev;	/**< REC_EVENT: evento despachado */
+	uint8_t state;	/**< REC_EVENT: estado depois do despacho */
+};
+
+BUILD_ASSERT(sizeof(struct rec_entry) == 12, "recording format is 12 bytes per entry");
+
+/** @brief Cabeçalho do ficheiro de gravaçao (seguido de count registos) */
+struct rec_file_header {
+	char magic[4];		/**< REC_FILE_MAGIC */
+	uint8_t version;	/**< REC_FILE_VERSION */
+	uint8_t entry_size;	/**< sizeof(struct rec_entry) */
+	uint16_t lanes;		/**< CONFIG_VENDING_LANES da unidade gravada */
+	uint32_t count;
+};
+
+#define REC_FILE_MAGIC "VREC"
+#define REC_FILE_VERSION 2
+
+/** @brief Intervalo do registo em us */
+static inline uint64_t rec_dt_us(const struct rec_entry *e)
+{
+	return (e->dt & REC_DT_MS) ? (uint64_t)(e->dt & ~REC_DT_MS) * USEC_PER_MSEC : e->dt;
+}
+
+#ifdef CONFIG_VENDING_RECORDER
+
+/** @brief Regista os pinos que dispararam a callback da porta port (contexto de ISR) */
+void recorder_edge(uint8_t port, uint32_t pins);
+
+/** @brief Regista um evento despachado e o estado resultante do painel */
+void recorder_event(uint8_t lane, Event ev, uint8_t state);
+
+/** @brief Regista um acerto da hora do dia (a reproduçao repoe a mesma hora) */
+void recorder_clock(uint16_t minute_of_day);
+
+/** @brief Imprime o anel, do registo mais antigo para o mais recente
+ * Formato: "REC BEGIN <registos> <paineis>", uma linha "REC <24 digitos hex>" por registo
+ * e "REC END". A gravaçao fica suspensa durante a impressao. */
+void recorder_dump(void);
+
+#else
+
+static inline void recorder_edge(uint8_t port, uint32_t pins) { }
+static inline void recorder_event(uint8_t lane, Event ev, uint8_t state) { }
+static inline void recorder_clock(uint16_t minute_of_day) { }
+static inline void recorder_dump(void) { }
+
+#endif /* CONFIG_VENDING_RECORDER */
+
+#ifdef CONFIG_VENDING_REPLAY
+
+/** @brief Filas dos paineis onde a reproduçao coloca os eventos gravados */
+void recorder_replay_init(struct event_ring *const rings[VM_LANES], struct k_sem *wake);
+
+/** @brief Chamada por main() com a thread vm_fsm iniciada: so entao a reproduçao começa */
+void recorder_replay_ready(void);
+
+/** @brief Compara um evento despachado com o gravado (chamada por recorder_event()) */
+void recorder_replay_check(uint8_t lane, Event ev, uint8_t state);
+
+#else
+
+static inline void recorder_replay_init(struct event_ring *const rings[VM_LANES],
+					struct k_sem *wake) { }
+static inline void recorder_replay_ready(void) { }
+static inline void recorder_replay_check(uint8_t lane, Event ev, uint8_t state) { }
+
+#endif /* CONFIG_VENDING_REPLAY */
+
+#endif /* RECORDER_H_ */
@@ -0,0 +1,211 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file recorder_replay.c
+* \brief Reproduçao de uma gravaçao em native_posix: -replay=<ficheiro> [-replay-fast]
+*
+* Os eventos gravados (REC_EVENT) sao colocados nas filas dos paineis com os intervalos
+* originais (em tempo simulado) ou seguidos com -replay-fast, e cada despacho é comparado
+* com o evento e o estado gravados. Os acertos da hora sao repostos; os flancos (REC_EDGE)
+* servem so para analise, porque o debounce ja os transformou nos eventos gravados.
+* No fim é impresso o numero de divergencias e o debito em eventos/s medido no relogio do
+* host, e a aplicaçao termina (codigo 1 se houver divergencias).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr.h>
+#include <zephyr/sys/printk.h>
+#include <native_rtc.h>
+#include <posix_board_if.h>
+
+#include "cmdline.h"
+#include "soc.h"
+
+#include "recorder.h"
+#include "wallclock.h"
+
+#define REC_ENTRIES CONFIG_VENDING_RECORDER_ENTRIES
+/** @brief Eventos em transito (colocados e ainda nao despachados), abaixo da capacidade da fila */
+#define REPLAY_IN_FLIGHT (EVENT_RING_SIZE / 2)
+
+static char *replay_path;
+static bool replay_fast;
+
+static void replay_options(void)
+{
+	static struct args_struct_t replay_opts[] = {
+		{ .manual = false, .is_mandatory = false, .is_switch = false,
+		  .option = "replay", .name = "path", .type = 's',
+		  .dest = (void *)&replay_path, .call_when_found = NULL,
+		  .descript = "Recording to replay (scripts/rec_extract.py output)" },
+		{ .manual = false, .is_mandatory = false, .is_switch = true,
+		  .option = "replay-fast", .name = "", .type = 'b',
+		  .dest = (void *)&replay_fast, .call_when_found = NULL,
+		  .descript = "Replay events back to back instead of at the recorded times" },
+		ARG_TABLE_ENDMARKER
+	};
+
+	native_add_command_line_opts(replay_opts);
+}
+
+NATIVE_TASK(replay_options, PRE_BOOT_1, 1);
+
+/** @brief Gravaçao carregada do ficheiro */
+static struct rec_entry rec[REC_ENTRIES];
+static uint32_t rec_count;
+/** @brief Eventos da gravaçao com painel existente nesta build */
+static uint32_t rec_events;
+
+static struct event_ring *replay_ring[VM_LANES];
+static struct k_sem *replay_wake;
+static bool replay_active;
+
+/** @brief Proximo registo a comparar de cada painel (so usado pela thread vm_fsm) */
+static uint32_t expect_pos[VM_LANES];
+static uint32_t checked;
+static uint32_t mismatches;
+
+K_SEM_DEFINE(replay_slots, REPLAY_IN_FLIGHT, REPLAY_IN_FLIGHT);
+K_SEM_DEFINE(replay_done, 0, 1);
+static K_SEM_DEFINE(replay_ready, 0, 1);
+
+void recorder_replay_init(struct event_ring *const rings[VM_LANES], struct k_sem *wake)
+{
+	int i;
+
+	for (i = 0; i < VM_LANES; i++) {
+		replay_ring[i] = rings[i];
+	}
+	replay_wake = wake;
+}
+
+void recorder_replay_ready(void)
+{
+	k_sem_give(&replay_ready);
+}
+
+void recorder_replay_check(uint8_t lane, Event ev, uint8_t state)
+{
+	uint32_t i;
+
+	if (!replay_active || lane >= VM_LANES) {
+		return;
+	}
+	for (i = expect_pos[lane]; i < rec_count; i++) {
+		if (rec[i].kind == REC_EVENT && rec[i].lane == lane) {
+			break;
+		}
+	}
+	if (i < rec_count && (rec[i].ev != ev || rec[i].state != state)) {
+		if (mismatches < 8) {
+			printk("REPLAY: divergencia no registo %u, painel %u: evento %u estado %u, "
+			       "gravado evento %u estado %u\n", i, lane, ev, state, rec[i].ev,
+			       rec[i].state);
+		}
+		mismatches++;
+	}
+	expect_pos[lane] = i + 1;
+	k_sem_give(&replay_slots);
+	if (++checked == rec_events) {
+		k_sem_give(&replay_done);
+	}
+}
+
+/** @brief Le o ficheiro para rec[]
+ * @return 0 ou -1 se o ficheiro nao existir ou tiver outro formato */
+static int replay_load(void)
+{
+	struct rec_file_header h;
+	FILE *f;
+	uint32_t i;
+
+	f = fopen(replay_path, "rb");
+	if (f == NULL) {
+		printk("REPLAY: nao foi possivel abrir %s\n", replay_path);
+		return -1;
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, REC_FILE_MAGIC, 4) != 0 ||
+	    h.version != REC_FILE_VERSION || h.entry_size != sizeof(struct rec_entry)) {
+		printk("REPLAY: %s nao é uma gravacao (versao %u)\n", replay_path, REC_FILE_VERSION);
+		fclose(f);
+		return -1;
+	}
+	if (h.count > REC_ENTRIES) {
+		printk("REPLAY: %u registos, so os primeiros %u sao reproduzidos\n", h.count,
+		       REC_ENTRIES);
+	}
+	rec_count = fread(rec, sizeof(struct rec_entry), MIN(h.count, REC_ENTRIES), f);
+	fclose(f);
+
+	if (h.lanes != VM_LANES) {
+		printk("REPLAY: gravado com %u paineis, esta build tem %u\n", h.lanes, VM_LANES);
+	}
+	for (i = 0; i < rec_count; i++) {
+		if (rec[i].kind == REC_EVENT && rec[i].lane < VM_LANES && rec[i].ev > NONE &&
+		    rec[i].ev < NUM_EVENTS) {
+			rec_events++;
+		}
+	}
+	return 0;
+}
+
+static void replay_thread(void *p1, void *p2, void *p3)
+{
+	const struct rec_entry *e;
+	uint64_t host_t0, host_us;
+	int64_t sim_t0, due;
+	uint64_t elapsed = 0;
+	uint32_t i;
+
+	if (replay_path == NULL) {
+		return;
+	}
+	/* Esperar que main() configure os paineis e inicie a thread vm_fsm */
+	k_sem_take(&replay_ready, K_FOREVER);
+	if (replay_load() < 0) {
+		posix_exit(1);
+	}
+	printk("REPLAY: %u registos, %u eventos, %s\n", rec_count, rec_events,
+	       replay_fast ? "velocidade maxima" : "tempos originais");
+
+	replay_active = true;
+	host_t0 = native_rtc_gettime_us(RTC_CLOCK_REALTIME);
+	sim_t0 = k_ticks_to_us_floor64(k_uptime_ticks());
+	for (i = 0; i < rec_count; i++) {
+		e = &rec[i];
+		/* soma dos intervalos desde o primeiro registo, cujo intervalo é ignorado */
+		if (i > 0) {
+			elapsed += rec_dt_us(e);
+		}
+		if (!replay_fast) {
+			due = sim_t0 + (int64_t)elapsed;
+			if (due > k_ticks_to_us_floor64(k_uptime_ticks())) {
+				k_sleep(K_USEC(due - k_ticks_to_us_floor64(k_uptime_ticks())));
+			}
+		}
+		if (e->kind == REC_CLOCK) {
+#ifdef CONFIG_VENDING_WALLCLOCK
+			wallclock_set(e->arg);
+#endif
+		} else if (e->kind == REC_EVENT && e->lane < VM_LANES && e->ev > NONE &&
+			   e->ev < NUM_EVENTS) {
+			k_sem_take(&replay_slots, K_FOREVER);
+			event_ring_push(replay_ring[e->lane], (Event)e->ev);
+			k_sem_give(replay_wake);
+		}
+	}
+	if (rec_events > 0) {
+		k_sem_take(&replay_done, K_FOREVER);
+	}
+	host_us = native_rtc_gettime_us(RTC_CLOCK_REALTIME) - host_t0;
+
+	printk("REPLAY: %u eventos, %u divergencias, %u us no host (%u eventos/s)\n", checked,
+	       mismatches, (uint32_t)host_us,
+	       host_us ? (uint32_t)((uint64_t)checked * 1000000U / host_us) : 0U);
+	posix_exit(mismatches ? 1 : 0);
+}
+
+K_THREAD_DEFINE(recorder_replay, 1024, replay_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
@@ -0,0 +1,222 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file seats.c
+* \brief Mapas de bits dos lugares de cada sessao (ver seats.h)
+*/
+
+#include <errno.h>
+#include <zephyr.h>
+
+#include "seats.h"
+
+#define SEATS_MAX_SESSIONS CONFIG_VENDING_CATALOG_MAX_SESSIONS
+
+BUILD_ASSERT(SEATS_PER_ROW <= 32 && SEAT_ROWS <= 32, "one 32-bit word per row and per row mask");
+
+/** @brief Bits de uma fila que nao correspondem a lugares (sempre ocupados) */
+#define ROW_PAD ((uint32_t)(SEATS_PER_ROW == 32 ? 0U : ~0U << (SEATS_PER_ROW % 32)))
+
+/** @brief Mascara com todas as filas */
+#define ALL_ROWS ((uint32_t)(SEAT_ROWS == 32 ? ~0U : (1U << SEAT_ROWS) - 1U))
+
+/** @brief Situaçao de uma sala durante seats_remap() */
+enum slot_state {
+	SLOT_OLD,	/**< sala de uma sessao do catalogo anterior ainda nao colocada */
+	SLOT_PLACED,	/**< sala ja na posiçao da sessao do catalogo novo */
+	SLOT_EMPTY,	/**< fora do catalogo anterior */
+};
+
+/** @brief Estado dos lugares de uma sessao */
+struct session_seats {
+	uint32_t row[SEAT_ROWS];	/**< bit a 1 = lugar vendido */
+	uint32_t rows_free;		/**< bit r a 1 = fila r tem lugares livres */
+	uint16_t free;			/**< numero de lugares livres */
+	str_handle_t title;		/**< sessao a que a sala pertence: filme e hora */
+	uint8_t hour;
+	uint8_t slot;			/**< enum slot_state (so usado por seats_remap()) */
+};
+
+static struct session_seats seats[SEATS_MAX_SESSIONS];
+static uint16_t seats_count;
+
+/** @brief Sala vazia para a sessao idx do catalogo */
+static void seats_clear(const struct catalog *c, uint16_t idx)
+{
+	int r;
+
+	for (r = 0; r < SEAT_ROWS; r++) {
+		seats[idx].row[r] = ROW_PAD;
+	}
+	seats[idx].rows_free = ALL_ROWS;
+	seats[idx].free = SEATS_PER_SESSION;
+	seats[idx].title = catalog_title(c, idx);
+	seats[idx].hour = catalog_hour(c, idx);
+}
+
+int seats_init(const struct catalog *c)
+{
+	uint16_t s;
+
+	if (catalog_count(c) > SEATS_MAX_SESSIONS) {
+		return -ENOMEM;
+	}
+	for (s = 0; s < catalog_count(c); s++) {
+		seats_clear(c, s);
+	}
+	seats_count = catalog_count(c);
+	return 0;
+}
+
+/** @brief Procura em [from, to) a sala por colocar da sessao idx do catalogo (mesmo filme e
+ * mesma hora)
+ * @return posiçao da sala ou to */
+static uint16_t seats_find(const struct catalog *c, uint16_t idx, uint16_t from, uint16_t to)
+{
+	uint16_t s;
+
+	for (s = from; s < to; s++) {
+		if (seats[s].slot == SLOT_OLD && seats[s].title == catalog_title(c, idx) &&
+		    seats[s].hour == catalog_hour(c, idx)) {
+			break;
+		}
+	}
+	return s;
+}
+
+int seats_remap(const struct catalog *c)
+{
+	uint16_t n = catalog_count(c);
+	uint16_t ext = MAX(n, seats_count);
+	struct session_seats tmp;
+	uint16_t s, p;
+
+	if (n > SEATS_MAX_SESSIONS) {
+		return -ENOMEM;
+	}
+	for (s = 0; s < ext; s++) {
+		seats[s].slot = s < seats_count ? SLOT_OLD : SLOT_EMPTY;
+	}
+	/* As salas por colocar estao sempre em posiçoes SLOT_OLD: a troca leva a sala que
+	 * ocupava a posiçao s para a posiçao p, onde continua a poder ser encontrada. Sem
+	 * mudanças na ordem a sala esta ja na mesma posiçao e a procura é O(1) por sessao */
+	for (s = 0; s < n; s++) {
+		p = seats_find(c, s, s, ext);
+		if (p == ext) {
+			p = seats_find(c, s, 0, s);
+			if (p == s) {
+				continue;
+			}
+		}
+		if (p != s) {
+			tmp = seats[s];
+			seats[s] = seats[p];
+			seats[p] = tmp;
+		}
+		seats[s].slot = SLOT_PLACED;
+	}
+	/* Sessoes novas ou com filme/hora diferentes: sala vazia */
+	for (s = 0; s < n; s++) {
+		if (seats[s].slot != SLOT_PLACED) {
+			seats_clear(c, s);
+		}
+	}
+	seats_count = n;
+	return 0;
+}
+
+uint16_t seats_free(uint16_t session)
+{
+	return session < seats_count ? seats[session].free : 0;
+}
+
+/** @brief Marca os lugares de mask na fila r como vendidos */
+static void seats_mark(struct session_seats *ss, int r, uint32_t mask)
+{
+	ss->row[r] |= mask;
+	ss->free -= __builtin_popcount(mask);
+	if (ss->row[r] == ~0U) {
+		ss->rows_free &= ~BIT(r);
+	}
+}
+
+int seats_take(uint16_t session)
+{
+	struct session_seats *ss;
+	int r, c;
+
+	if (session >= seats_count || seats[session].free == 0) {
+		return -ENOSPC;
+	}
+	ss = &seats[session];
+	r = __builtin_ctz(ss->rows_free);
+	c = __builtin_ctz(~ss->row[r]);
+	seats_mark(ss, r, BIT(c));
+	return r * SEATS_PER_ROW + c;
+}
+
+/** @brief Posiçoes onde começam n bits a 1 seguidos em free (bit i a 1 se free[i..i+n-1] a 1)
+ * duplica o comprimento da sequencia verificada em cada passo: O(log n) operaçoes */
+static uint32_t runs_of(uint32_t free, uint8_t n)
+{
+	uint8_t len = 1;
+	uint8_t step;
+
+	while (len < n && free) {
+		step = MIN(len, n - len);
+		free &= free >> step;
+		len += step;
+	}
+	return free;
+}
+
+int seats_take_adjacent(uint16_t session, uint8_t n)
+{
+	struct session_seats *ss;
+	uint32_t rows, starts;
+	int r, c;
+
+	if (n == 0 || n > SEATS_PER_ROW) {
+		return -EINVAL;
+	}
+	if (session >= seats_count || seats[session].free < n) {
+		return -ENOSPC;
+	}
+	ss = &seats[session];
+	for (rows = ss->rows_free; rows; rows &= rows - 1U) {
+		r = __builtin_ctz(rows);
+		/* ROW_PAD esta a 1, por isso nenhuma sequencia passa para la do fim da fila */
+		starts = runs_of(~ss->row[r], n);
+		if (starts) {
+			c = __builtin_ctz(starts);
+			seats_mark(ss, r, (n == 32 ? ~0U : BIT_MASK(n)) << c);
+			return r * SEATS_PER_ROW + c;
+		}
+	}
+	return -ENOSPC;
+}
+
+void seats_release(uint16_t session, uint16_t seat, uint8_t n)
+{
+	struct session_seats *ss;
+	uint32_t mask;
+	uint8_t r = seat_row(seat);
+
+	if (session >= seats_count || r >= SEAT_ROWS || n == 0 || seat_col(seat) + n > SEATS_PER_ROW) {
+		return;
+	}
+	ss = &seats[session];
+	mask = (n == 32 ? ~0U : BIT_MASK(n)) << seat_col(seat);
+	mask &= ss->row[r];
+	ss->row[r] &= ~mask;
+	ss->free += __builtin_popcount(mask);
+	if (mask) {
+		ss->rows_free |= BIT(r);
+	}
+}
+
+size_t seats_mem_size(void)
+{
+	return sizeof(seats[0]) * seats_count;
+}
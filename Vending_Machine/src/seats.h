@@ -0,0 +1,72 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file seats.h
+* \brief Lugares de cada sessao do catalogo
+*
+* Cada sessao tem uma sala de CONFIG_VENDING_SEAT_ROWS filas com CONFIG_VENDING_SEATS_PER_ROW
+* lugares. Cada fila é uma palavra de 32 bits (bit a 1 = lugar vendido, os bits acima do
+* numero de lugares ficam sempre a 1) e cada sessao tem ainda uma mascara das filas com lugares
+* livres e o numero de lugares livres, pelo que verificar disponibilidade é O(1) e encontrar
+* um lugar sao duas instruçoes ctz. Os lugares sao numerados fila * SEATS_PER_ROW + coluna.
+*
+* As salas sao indexadas pela posiçao da sessao no catalogo e guardam o filme e a hora da
+* sessao, para que uma troca de catalogo (seats_remap()) nao passe os lugares vendidos de
+* uma sessao para outra.
+*/
+
+#ifndef SEATS_H_
+#define SEATS_H_
+
+#include <zephyr.h>
+
+#include "catalog.h"
+
+#define SEAT_ROWS	CONFIG_VENDING_SEAT_ROWS
+#define SEATS_PER_ROW	CONFIG_VENDING_SEATS_PER_ROW
+
+/** @brief Lugares por sessao */
+#define SEATS_PER_SESSION (SEAT_ROWS * SEATS_PER_ROW)
+
+/** @brief Sala vazia para cada sessao do catalogo
+ * @return 0 ou -ENOMEM se o catalogo tiver mais sessoes que CONFIG_VENDING_CATALOG_MAX_SESSIONS */
+int seats_init(const struct catalog *c);
+
+/** @brief Catalogo trocado: cada sala acompanha a sua sessao (mesmo filme e mesma hora)
+ * para a posiçao que esta ocupa no catalogo novo; as sessoes novas, ou cujo filme ou hora
+ * mudaram, começam vazias e as salas das sessoes retiradas sao descartadas.
+ * O(n) se a ordem das sessoes nao mudou, O(n^2) no pior caso
+ * @return 0 ou -ENOMEM */
+int seats_remap(const struct catalog *c);
+
+/** @brief Numero de lugares livres da sessao (O(1)) */
+uint16_t seats_free(uint16_t session);
+
+/** @brief Vende o primeiro lugar livre da sessao
+ * @return numero do lugar ou -ENOSPC se a sessao estiver esgotada */
+int seats_take(uint16_t session);
+
+/** @brief Vende n lugares seguidos na mesma fila (compra de grupo)
+ * @return numero do primeiro lugar ou -ENOSPC (-EINVAL se n nao couber numa fila) */
+int seats_take_adjacent(uint16_t session, uint8_t n);
+
+/** @brief Liberta n lugares seguidos a partir de seat (anulaçao de uma venda) */
+void seats_release(uint16_t session, uint16_t seat, uint8_t n);
+
+/** @brief Memoria (bytes) ocupada pelos mapas de lugares */
+size_t seats_mem_size(void);
+
+/** @brief Fila (0 = A) do lugar */
+static inline uint8_t seat_row(uint16_t seat)
+{
+	return seat / SEATS_PER_ROW;
+}
+
+/** @brief Coluna (0..SEATS_PER_ROW-1) do lugar */
+static inline uint8_t seat_col(uint16_t seat)
+{
+	return seat % SEATS_PER_ROW;
+}
+
+#endif /* SEATS_H_ */
@@ -0,0 +1,296 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file sim_harness.c
+* \brief Harness de injeçao de eventos para a build native_posix
+*
+* Reproduz scripts de eventos (rajadas de moedas, scroll, compras) atraves do emulador de
+* GPIO, passando pela callback dos botoes, debounce, fila de eventos e maquina de estados.
+* Com CONFIG_VENDING_LANES > 1 cada pressao é feita ao mesmo tempo em todos os paineis,
+* para medir o escalonador com todos os paineis carregados.
+* No fim de cada script imprime eventos/segundo, percentis da latencia (injeçao -> fim do
+* despacho) e eventos perdidos. Cada despacho é emparelhado com a injeçao mais antiga do
+* mesmo evento no mesmo painel; os NONE (ex.: timer da hora) nao contam. Os tempos sao medidos no relogio real do host, pelo que
+* a build deve correr sem abrandar para tempo real (CONFIG_NATIVE_POSIX_SLOWDOWN_TO_REAL_TIME=n).
+*/
+
+#include <zephyr.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <native_rtc.h>
+#include <posix_board_if.h>
+
+#include "buttons.h"
+#include "sim_harness.h"
+
+#define SIM_MAX_SAMPLES CONFIG_VENDING_SIM_MAX_SAMPLES
+
+#define EVENT_PIN(lane, pin, ev, ms) [lane][ev] = pin,
+#define EVENT_STABLE(lane, pin, ev, ms) [ev] = ms,
+
+/** @brief Pino de cada evento em cada painel (inverso de BUTTONS_LIST) */
+static const uint8_t event_pin[VM_LANES][NUM_EVENTS] = { BUTTONS_LIST(EVENT_PIN) };
+/** @brief Tempo de estabilizaçao de cada evento (igual em todos os paineis) */
+static const uint8_t event_stable_ms[NUM_EVENTS] = { BUTTONS_LANE0(EVENT_STABLE) };
+
+/** @brief Passo de um script: evento a injetar e numero de repetiçoes */
+struct sim_step {
+	Event ev;
+	uint16_t count;
+};
+
+/** @brief Script de eventos */
+struct sim_script {
+	const char *name;
+	const struct sim_step *steps;
+	size_t n_steps;
+	uint16_t loops;		/**< repetiçoes do script completo */
+	uint16_t gap_ms;	/**< pausa entre eventos, depois de soltar o botao */
+};
+
+static const struct sim_step coin_burst[] = {
+	{ ADD1, 1 }, { ADD2, 1 }, { ADD5, 1 }, { ADD10, 1 }, { RET, 1 },
+};
+
+static const struct sim_step scroll_storm[] = {
+	{ UP, 20 }, { DOWN, 20 },
+};
+
+static const struct sim_step purchase[] = {
+	{ ADD10, 1 }, { ADD2, 1 }, { UP, 1 }, { DOWN, 1 }, { SEL, 1 }, { RET, 1 },
+};
+
+#define SIM_SCRIPT(_name, _steps, _loops, _gap) \
+	{ .name = _name, .steps = _steps, .n_steps = ARRAY_SIZE(_steps), .loops = _loops, .gap_ms = _gap }
+
+static const struct sim_script scripts[] = {
+	SIM_SCRIPT("coin burst", coin_burst, 40, 0),
+	SIM_SCRIPT("scroll storm", scroll_storm, 10, 0),
+	SIM_SCRIPT("purchases", purchase, 40, 0),
+};
+
+/** @brief Porta GPIO de cada painel (BUTTONS_LANE_PORT) */
+static const struct device *const lane_dev[VM_LANES] = {
+	DEVICE_DT_GET(DT_NODELABEL(gpio0)),
+#if VM_LANES > 1
+	DEVICE_DT_GET(DT_NODELABEL(gpio1)),
+#endif
+#if VM_LANES > 2
+	DEVICE_DT_GET(DT_NODELABEL(gpio1)),
+#endif
+};
+
+/** @brief Injeçao de um evento num painel */
+struct sim_inject {
+	uint64_t t_us;	/**< instante (relogio do host) em que o botao foi solto */
+	Event ev;
+};
+
+/** @brief Injeçoes do script atual em cada painel, por ordem */
+static struct sim_inject inject[VM_LANES][SIM_MAX_SAMPLES];
+static atomic_t injected[VM_LANES];
+/** @brief Proxima injeçao por emparelhar de cada painel (so usado pela thread vm_fsm) */
+static uint32_t inject_next[VM_LANES];
+/** @brief Despachos emparelhados com uma injeçao */
+static atomic_t dispatched;
+/** @brief Latencias medidas (us) do script atual */
+static uint32_t latency_us[SIM_MAX_SAMPLES];
+
+/** @brief Dado por main() quando a maquina esta pronta para receber eventos */
+static K_SEM_DEFINE(sim_ready, 0, 1);
+
+static uint64_t sim_now_us(void)
+{
+	return native_rtc_gettime_us(RTC_CLOCK_REALTIME);
+}
+
+void sim_harness_ready(void)
+{
+	k_sem_give(&sim_ready);
+}
+
+void sim_harness_dispatched(uint8_t lane, Event ev)
+{
+	uint32_t end = MIN((uint32_t)atomic_get(&injected[lane]), SIM_MAX_SAMPLES);
+	uint32_t i;
+	atomic_val_t n;
+
+	if (ev == NONE || lane >= VM_LANES) {
+		return;
+	}
+	/* As injeçoes de outros eventos antes desta perderam-se (fila cheia): ficam por emparelhar */
+	i = inject_next[lane];
+	while (i < end && inject[lane][i].ev != ev) {
+		i++;
+	}
+	if (i == end) {
+		return;
+	}
+	inject_next[lane] = i + 1;
+	n = atomic_inc(&dispatched);
+	if (n < SIM_MAX_SAMPLES) {
+		latency_us[n] = (uint32_t)(sim_now_us() - inject[lane][i].t_us);
+	}
+}
+
+/** @brief Injeta uma pressao em todos os paineis
+ * Como na placa (pull-up, ativo a 1): premir leva o pino a 0 e o evento nasce do flanco para
+ * ativo ao soltar, confirmado depois do tempo de estabilizaçao */
+static void sim_press(Event ev, uint16_t gap_ms)
+{
+	uint32_t n;
+	int lane;
+
+	for (lane = 0; lane < VM_LANES; lane++) {
+		gpio_emul_input_set(lane_dev[lane], event_pin[lane][ev], 0);
+	}
+	k_sleep(K_MSEC(1));
+	for (lane = 0; lane < VM_LANES; lane++) {
+		n = (uint32_t)atomic_get(&injected[lane]);
+		if (n < SIM_MAX_SAMPLES) {
+			inject[lane][n].t_us = sim_now_us();
+			inject[lane][n].ev = ev;
+		}
+		atomic_inc(&injected[lane]);
+		gpio_emul_input_set(lane_dev[lane], event_pin[lane][ev], 1);
+	}
+	k_sleep(K_MSEC(event_stable_ms[ev] + 1));
+	if (gap_ms) {
+		k_sleep(K_MSEC(gap_ms));
+	}
+}
+
+/** @brief Botoes soltos no arranque: o emulador nao tem pull-up, sem isto os pinos ficavam a 0
+ * (premidos). Corre antes de main() para que a subida para 1 nao gere flancos nos botoes */
+static int sim_idle_levels(const struct device *unused)
+{
+	int lane, ev;
+
+	for (lane = 0; lane < VM_LANES; lane++) {
+		for (ev = ADD1; ev < NUM_EVENTS; ev++) {
+			gpio_pin_configure(lane_dev[lane], event_pin[lane][ev], GPIO_INPUT);
+			gpio_emul_input_set(lane_dev[lane], event_pin[lane][ev], 1);
+		}
+	}
+	return 0;
+}
+
+SYS_INIT(sim_idle_levels, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/** @brief Ordena as latencias (shell sort, sem depender de qsort na libc minima) */
+static void sort_u32(uint32_t *v, size_t n)
+{
+	size_t gap, i, j;
+	uint32_t tmp;
+
+	for (gap = n / 2; gap > 0; gap /= 2) {
+		for (i = gap; i < n; i++) {
+			tmp = v[i];
+			for (j = i; j >= gap && v[j - gap] > tmp; j -= gap) {
+				v[j] = v[j - gap];
+			}
+			v[j] = tmp;
+		}
+	}
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, unsigned int p)
+{
+	return n ? sorted[((n - 1) * p) / 100] : 0;
+}
+
+/** @brief Corre um script e imprime os resultados */
+static void sim_run(const struct sim_script *s)
+{
+	uint64_t t0, elapsed;
+	uint32_t n_inj = 0, n_disp, n;
+	size_t i;
+	uint16_t loop, k;
+	int lane;
+
+	/* Os eventos do script anterior ja foram todos despachados (pausa no fim de sim_run()) */
+	for (lane = 0; lane < VM_LANES; lane++) {
+		atomic_set(&injected[lane], 0);
+		inject_next[lane] = 0;
+	}
+	atomic_set(&dispatched, 0);
+
+	t0 = sim_now_us();
+	for (loop = 0; loop < s->loops; loop++) {
+		for (i = 0; i < s->n_steps; i++) {
+			for (k = 0; k < s->steps[i].count; k++) {
+				sim_press(s->steps[i].ev, s->gap_ms);
+			}
+		}
+	}
+	/* Dar tempo à maquina de estados para esvaziar a fila */
+	k_sleep(K_MSEC(100));
+	elapsed = sim_now_us() - t0;
+
+	for (lane = 0; lane < VM_LANES; lane++) {
+		n_inj += (uint32_t)atomic_get(&injected[lane]);
+	}
+	n_disp = (uint32_t)atomic_get(&dispatched);
+	n = MIN(n_disp, SIM_MAX_SAMPLES);
+	sort_u32(latency_us, n);
+
+	printk("SIM %s: %d paineis, %u injetados, %u processados, %u perdidos, %u eventos/s\n",
+	       s->name, VM_LANES, n_inj, n_disp, n_inj - MIN(n_inj, n_disp),
+	       elapsed ? (uint32_t)((uint64_t)n_disp * 1000000U / elapsed) : 0U);
+	printk("SIM %s: latencia us p50 %u p90 %u p99 %u max %u\n", s->name,
+	       percentile(latency_us, n, 50), percentile(latency_us, n, 90),
+	       percentile(latency_us, n, 99), percentile(latency_us, n, 100));
+}
+
+/** @brief Baixo consumo com todos os botoes soltos: nenhum flanco nem evento pode aparecer;
+ * depois uma pressao tem de acordar a maquina e gerar um unico evento por painel
+ * @return true se passou */
+static bool sim_suspend_check(void)
+{
+	struct buttons_isr_stats before, idle, after;
+	uint32_t edge;
+	bool quiet, woke;
+
+	buttons_isr_stats_get(&before);
+	buttons_suspend();
+	k_sleep(K_MSEC(50));
+	buttons_isr_stats_get(&idle);
+	quiet = !buttons_sensed(&edge) && idle.calls == before.calls &&
+		idle.confirmed == before.confirmed;
+
+	/* RET sem credito: so imprime "0 EUR return" */
+	sim_press(RET, 0);
+	buttons_isr_stats_get(&after);
+	woke = buttons_sensed(&edge) && after.confirmed - idle.confirmed == VM_LANES;
+	buttons_resume();
+
+	printk("SIM suspend: soltos %u flancos %u eventos, pressao %u eventos: %s\n",
+	       idle.calls - before.calls, idle.confirmed - before.confirmed,
+	       after.confirmed - idle.confirmed, quiet && woke ? "PASS" : "FAIL");
+	return quiet && woke;
+}
+
+static void sim_thread(void *p1, void *p2, void *p3)
+{
+	size_t i;
+
+	/* Esperar que main() configure os botoes e arranque a thread vm_fsm */
+	k_sem_take(&sim_ready, K_FOREVER);
+
+	for (i = 0; i < ARRAY_SIZE(scripts); i++) {
+		sim_run(&scripts[i]);
+	}
+	if (!sim_suspend_check()) {
+		printk("SIM FAIL\n");
+		posix_exit(1);
+	}
+	printk("SIM DONE\n");
+	posix_exit(0);
+}
+
+K_THREAD_DEFINE(sim_harness, 1024, sim_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
@@ -0,0 +1,27 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file sim_harness.h
+* \brief Harness de injeçao de eventos para a build native_posix (emulador de GPIO)
+*/
+
+#ifndef SIM_HARNESS_H_
+#define SIM_HARNESS_H_
+
+#include "vending.h"
+
+#ifdef CONFIG_VENDING_SIM_HARNESS
+/** @brief Chamada pela maquina de estados no fim do despacho de cada evento do painel lane
+ * usada para medir a latencia desde a injeçao no GPIO e contar eventos perdidos */
+void sim_harness_dispatched(uint8_t lane, Event ev);
+
+/** @brief Chamada por main() com os botoes configurados e a thread vm_fsm iniciada:
+ * so entao o harness começa a injetar */
+void sim_harness_ready(void);
+#else
+static inline void sim_harness_dispatched(uint8_t lane, Event ev) { }
+static inline void sim_harness_ready(void) { }
+#endif
+
+#endif /* SIM_HARNESS_H_ */
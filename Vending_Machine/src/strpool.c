@@ -0,0 +1,134 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file strpool.c
+* \brief Pool de strings com tabela de hash (ver strpool.h)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr.h>
+
+#include "strpool.h"
+
+#define STRPOOL_MAX_STRINGS CONFIG_VENDING_STRPOOL_MAX_STRINGS
+
+/** @brief Tabela de hash (enderecamento aberto) com o dobro das entradas das strings */
+#define HASH_SIZE (2U * STRPOOL_MAX_STRINGS)
+#define HASH_EMPTY 0xFFFF
+
+/** @brief String de cada handle (em flash ou na arena) */
+static const char *strs[STRPOOL_MAX_STRINGS];
+/** @brief Comprimento de cada string (sem o terminador) */
+static uint8_t lens[STRPOOL_MAX_STRINGS];
+static atomic_t n_strs;
+
+/** @brief Arena para as strings recebidas em tempo de execuçao */
+static char arena[CONFIG_VENDING_STRPOOL_SIZE];
+static size_t arena_used;
+
+/** @brief Handles indexados pelo hash da string */
+static uint16_t hash_table[HASH_SIZE];
+
+static struct strpool_stats stats;
+
+/** @brief Hash FNV-1a */
+static uint32_t str_hash(const char *s, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while (len--) {
+		h = (h ^ (uint8_t)*s++) * 16777619U;
+	}
+	return h;
+}
+
+/** @brief Posiçao de s na tabela de hash: a entrada com s ou a entrada livre onde a pôr
+ * s tem len bytes e pode nao ter terminador (titulos dentro de uma mensagem de delta) */
+static uint32_t hash_slot(const char *s, size_t len)
+{
+	uint32_t i = str_hash(s, len) % HASH_SIZE;
+	uint16_t h;
+
+	while ((h = hash_table[i]) != HASH_EMPTY) {
+		if (lens[h] == len && memcmp(strs[h], s, len) == 0) {
+			break;
+		}
+		i = (i + 1 < HASH_SIZE) ? i + 1 : 0;
+	}
+	return i;
+}
+
+int strpool_init(const char *const *builtin, uint16_t count)
+{
+	uint16_t i;
+
+	if (count > STRPOOL_MAX_STRINGS) {
+		return -ENOMEM;
+	}
+	memset(hash_table, 0xFF, sizeof(hash_table));
+	arena_used = 0;
+	memset(&stats, 0, sizeof(stats));
+	for (i = 0; i < count; i++) {
+		if (strlen(builtin[i]) > STRPOOL_MAX_LEN) {
+			return -EINVAL;
+		}
+		strs[i] = builtin[i];
+		lens[i] = strlen(builtin[i]);
+		hash_table[hash_slot(builtin[i], lens[i])] = i;
+		stats.flash_bytes += lens[i] + 1;
+	}
+	atomic_set(&n_strs, count);
+	return 0;
+}
+
+int strpool_intern(const char *s, size_t len)
+{
+	uint16_t n = (uint16_t)atomic_get(&n_strs);
+	uint32_t slot;
+	char *dst;
+
+	/* Um terminador a meio cortaria a string devolvida por strpool_get() */
+	if (len == 0 || len > STRPOOL_MAX_LEN || memchr(s, '\0', len) != NULL) {
+		return -EINVAL;
+	}
+	slot = hash_slot(s, len);
+	if (hash_table[slot] != HASH_EMPTY) {
+		stats.hits++;
+		return hash_table[slot];
+	}
+	if (n >= STRPOOL_MAX_STRINGS || arena_used + len + 1 > sizeof(arena)) {
+		return -ENOMEM;
+	}
+
+	dst = &arena[arena_used];
+	memcpy(dst, s, len);
+	dst[len] = '\0';
+	arena_used += len + 1;
+	strs[n] = dst;
+	lens[n] = len;
+	hash_table[slot] = n;
+	/* A string fica completa antes de o handle passar a ser valido */
+	atomic_set(&n_strs, n + 1);
+	return n;
+}
+
+const char *strpool_get(str_handle_t h)
+{
+	return strpool_valid(h) ? strs[h] : "";
+}
+
+bool strpool_valid(str_handle_t h)
+{
+	return h < (uint16_t)atomic_get(&n_strs);
+}
+
+void strpool_stats_get(struct strpool_stats *st)
+{
+	*st = stats;
+	st->strings = (uint16_t)atomic_get(&n_strs);
+	st->max_strings = STRPOOL_MAX_STRINGS;
+	st->ram_bytes = arena_used;
+	st->ram_size = sizeof(arena);
+}
@@ -0,0 +1,58 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file strpool.h
+* \brief Pool de strings (titulos dos filmes) com handles de 16 bits
+*
+* Cada titulo é guardado uma unica vez e as sessoes guardam so o handle (2 bytes). Os
+* titulos compilados ficam em flash e sao registados sem copia; os titulos recebidos em
+* tempo de execuçao sao copiados para uma arena em RAM de CONFIG_VENDING_STRPOOL_SIZE bytes.
+* strpool_get() devolve um ponteiro para a string no pool (nunca copia), pelo que pode ser
+* passado diretamente a vm_printf("%s"). As strings nunca sao libertadas.
+*
+* strpool_intern() so pode ser chamada de uma thread de cada vez (o carregador);
+* strpool_get() pode ser chamada de qualquer thread para handles ja devolvidos.
+*/
+
+#ifndef STRPOOL_H_
+#define STRPOOL_H_
+
+#include <zephyr.h>
+
+/** @brief Handle de uma string do pool */
+typedef uint16_t str_handle_t;
+
+/** @brief Comprimento maximo de uma string (sem o terminador) */
+#define STRPOOL_MAX_LEN 63
+
+/** @brief Estatisticas do pool */
+struct strpool_stats {
+	uint16_t strings;	/**< strings no pool */
+	uint16_t max_strings;
+	uint32_t flash_bytes;	/**< bytes das strings compiladas (com terminador) */
+	uint32_t ram_bytes;	/**< bytes usados na arena */
+	uint32_t ram_size;	/**< tamanho da arena */
+	uint32_t hits;		/**< strings interned que ja existiam */
+};
+
+/** @brief Regista as strings compiladas; o handle de builtin[i] é i
+ * @return 0, -ENOMEM (demasiadas strings) ou -EINVAL (string longa demais) */
+int strpool_init(const char *const *builtin, uint16_t count);
+
+/** @brief Devolve o handle de s (len bytes, sem terminador obrigatorio), acrescentando-a ao
+ * pool se ainda nao existir
+ * @return handle ou -ENOMEM (arena ou tabela cheia) / -EINVAL (string vazia, longa demais ou
+ * com um '\0' nos len bytes) */
+int strpool_intern(const char *s, size_t len);
+
+/** @brief String do handle (ponteiro para o pool, "" para handles invalidos) */
+const char *strpool_get(str_handle_t h);
+
+/** @brief O handle existe */
+bool strpool_valid(str_handle_t h);
+
+/** @brief Le as estatisticas */
+void strpool_stats_get(struct strpool_stats *st);
+
+#endif /* STRPOOL_H_ */
@@ -0,0 +1,171 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file trace.c
+* \brief Histogramas de latencia por tipo de evento (ver trace.h)
+*/
+
+#include <zephyr.h>
+#include <zephyr/sys/printk.h>
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "trace.h"
+#include "output.h"
+
+/** @brief Numero de classes: a classe k conta latencias em [2^(k-1), 2^k) ciclos */
+#define TRACE_BUCKETS 32
+
+/** @brief Eventos à espera que a saida seja enviada (so com saida diferida): tantos quantos
+ * cabem nas filas de eventos de todos os paineis */
+#define TRACE_PENDING (CONFIG_VENDING_EVENT_RING_SIZE * CONFIG_VENDING_LANES)
+
+/** @brief Saida diferida: o texto vai para o buffer e é enviado depois (DMA ou thread vm_output),
+ * por isso a latencia total so termina em trace_output_sent() */
+#if defined(CONFIG_VENDING_ASYNC_OUTPUT) || defined(CONFIG_VENDING_OUTPUT_THREAD)
+#define TRACE_DEFERRED 1
+#endif
+
+static const char *const event_names[NUM_EVENTS] = {
+	"NONE", "ADD1", "ADD2", "ADD5", "ADD10", "UP", "DOWN", "SEL", "RET",
+};
+
+static const char *const stage_names[TRACE_NUM_STAGES] = {
+	"fila", "fsm", "total",
+};
+
+/** @brief Histogramas [etapa][evento][classe] (contadores saturados a 65535) */
+static uint16_t hist[TRACE_NUM_STAGES][NUM_EVENTS][TRACE_BUCKETS];
+static struct k_spinlock trace_lock;
+
+#ifdef TRACE_DEFERRED
+/** @brief Evento cuja saida termina quando a UART enviar 'mark' bytes */
+struct trace_pending {
+	uint32_t mark;
+	uint32_t t_isr;
+	uint8_t ev;
+};
+static struct trace_pending pending[TRACE_PENDING];
+static uint16_t pending_head, pending_count;
+/** @brief Amostras totais perdidas por a lista de espera estar cheia, por evento */
+static uint32_t dropped[NUM_EVENTS];
+#endif
+
+static void trace_add(enum trace_stage stage, Event ev, uint32_t cycles)
+{
+	uint32_t k = cycles ? MIN(32U - __builtin_clz(cycles), TRACE_BUCKETS - 1U) : 0U;
+	uint16_t *b = &hist[stage][ev][k];
+
+	if (*b != UINT16_MAX) {
+		(*b)++;
+	}
+}
+
+void trace_init(void)
+{
+#ifdef CONFIG_TIMING_FUNCTIONS
+	timing_init();
+	timing_start();
+#endif
+}
+
+void trace_event(Event ev, uint32_t t_isr, uint32_t t_disp, uint32_t t_end)
+{
+	k_spinlock_key_t key = k_spin_lock(&trace_lock);
+
+	trace_add(TRACE_QUEUE, ev, t_disp - t_isr);
+	trace_add(TRACE_HANDLE, ev, t_end - t_disp);
+#ifdef TRACE_DEFERRED
+	if (pending_count < TRACE_PENDING) {
+		struct trace_pending *p = &pending[(pending_head + pending_count) % TRACE_PENDING];
+
+		p->mark = output_queued_bytes();
+		p->t_isr = t_isr;
+		p->ev = ev;
+		pending_count++;
+	} else {
+		dropped[ev]++;
+	}
+#else
+	/* printk direto é sincrono: a saida terminou no fim do despacho */
+	trace_add(TRACE_TOTAL, ev, t_end - t_isr);
+#endif
+	k_spin_unlock(&trace_lock, key);
+}
+
+void trace_output_sent(uint32_t sent)
+{
+#ifdef TRACE_DEFERRED
+	k_spinlock_key_t key = k_spin_lock(&trace_lock);
+	uint32_t now = trace_now();
+	struct trace_pending *p;
+
+	while (pending_count) {
+		p = &pending[pending_head];
+		if ((int32_t)(sent - p->mark) < 0) {
+			break;
+		}
+		trace_add(TRACE_TOTAL, (Event)p->ev, now - p->t_isr);
+		pending_head = (pending_head + 1) % TRACE_PENDING;
+		pending_count--;
+	}
+	k_spin_unlock(&trace_lock, key);
+#endif
+}
+
+void trace_dump(void)
+{
+	uint16_t row[TRACE_BUCKETS];
+	k_spinlock_key_t key;
+	int s, e, k;
+	bool empty;
+#ifdef TRACE_DEFERRED
+	uint32_t n;
+#endif
+
+	vm_printf("Latencias (ciclos, classe k = [2^(k-1), 2^k)):\n");
+	for (s = 0; s < TRACE_NUM_STAGES; s++) {
+		for (e = 1; e < NUM_EVENTS; e++) {
+			key = k_spin_lock(&trace_lock);
+			memcpy(row, hist[s][e], sizeof(row));
+			k_spin_unlock(&trace_lock, key);
+
+			empty = true;
+			for (k = 0; k < TRACE_BUCKETS && empty; k++) {
+				empty = (row[k] == 0);
+			}
+			if (empty) {
+				continue;
+			}
+			vm_printf("%s %s:", stage_names[s], event_names[e]);
+			for (k = 0; k < TRACE_BUCKETS; k++) {
+				if (row[k]) {
+					vm_printf(" %d:%u", k, row[k]);
+				}
+			}
+			vm_printf("\n");
+		}
+	}
+#ifdef TRACE_DEFERRED
+	for (e = 1; e < NUM_EVENTS; e++) {
+		key = k_spin_lock(&trace_lock);
+		n = dropped[e];
+		k_spin_unlock(&trace_lock, key);
+		if (n) {
+			vm_printf("%s %s: %u perdidas\n", stage_names[TRACE_TOTAL], event_names[e], n);
+		}
+	}
+#endif
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_trace(const struct shell *sh, size_t argc, char **argv)
+{
+	trace_dump();
+	return 0;
+}
+
+SHELL_CMD_REGISTER(vm_trace, NULL, "Dump vending machine latency histograms", cmd_trace);
+#endif
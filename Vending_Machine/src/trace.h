@@ -0,0 +1,67 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file trace.h
+* \brief Instrumentaçao do caminho botao -> maquina de estados -> saida
+*
+* Com CONFIG_VENDING_TRACE cada evento é marcado no flanco (ISR dos botoes), no inicio e
+* no fim do despacho e quando a sua saida termina de ser enviada. As latencias sao
+* acumuladas em histogramas logaritmicos (potencias de 2 de ciclos) por tipo de evento.
+* Sem essa opçao todas as funçoes sao vazias e nao geram codigo.
+*/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <zephyr.h>
+
+#include "vending.h"
+
+/** @brief Etapas medidas (todas a partir do flanco na ISR) */
+enum trace_stage {
+	TRACE_QUEUE,	/**< flanco -> inicio do despacho (debounce + fila) */
+	TRACE_HANDLE,	/**< inicio -> fim do despacho (maquina de estados + formataçao) */
+	TRACE_TOTAL,	/**< flanco -> saida enviada */
+	TRACE_NUM_STAGES
+};
+
+#ifdef CONFIG_VENDING_TRACE
+
+#include <zephyr/timing/timing.h>
+
+/** @brief Relogio do trace: contador de ciclos do CPU (DWT) ou k_cycle_get_32 */
+static inline uint32_t trace_now(void)
+{
+#ifdef CONFIG_TIMING_FUNCTIONS
+	return (uint32_t)timing_counter_get();
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+/** @brief Inicia o contador de ciclos */
+void trace_init(void);
+
+/** @brief Regista um evento despachado
+ * @param t_isr instante do flanco, t_disp inicio e t_end fim do despacho */
+void trace_event(Event ev, uint32_t t_isr, uint32_t t_disp, uint32_t t_end);
+
+/** @brief Indica que a saida diferida enviou todos os bytes ate sent (contagem acumulada)
+ * chamada pela UART no fim de cada transferencia ou pela thread vm_output depois de cada bloco */
+void trace_output_sent(uint32_t sent);
+
+/** @brief Imprime os histogramas nao vazios */
+void trace_dump(void);
+
+#else
+
+static inline uint32_t trace_now(void) { return 0; }
+static inline void trace_init(void) { }
+static inline void trace_event(Event ev, uint32_t t_isr, uint32_t t_disp, uint32_t t_end) { }
+static inline void trace_output_sent(uint32_t sent) { }
+static inline void trace_dump(void) { }
+
+#endif /* CONFIG_VENDING_TRACE */
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,74 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file vending.h
+* \brief Tipos comuns da maquina de venda (eventos e estados)
+*
+* Partilhado entre a callback dos botoes, a fila de eventos e a maquina de estados.
+*/
+
+#ifndef VENDING_H_
+#define VENDING_H_
+
+//----------------------------------------------------------------
+/** @brief Definicao de eventos
+ 	*  Enumeraçao de possiveis eventos criados pelos sistema */
+typedef enum {
+    NONE, ADD1, ADD2, ADD5, ADD10, UP, DOWN, SEL, RET, NUM_EVENTS
+} Event;
+
+/** @brief Definicao de Estados
+ 	*  Enumeraçao de estados do sistema */
+typedef enum{
+    MENU, MOVIES, UPDATE_CREDIT, NUM_STATES
+} States;
+
+/** @brief Numero de paineis (clientes) servidos pela mesma maquina de estados */
+#define VM_LANES CONFIG_VENDING_LANES
+
+#ifdef CONFIG_VENDING_FSM_BENCH
+/** @brief Micro-benchmark do despacho por tabela e por SMF contra o switch original (fsm_bench.c) */
+void fsm_bench_run(void);
+#endif
+
+#ifdef CONFIG_VENDING_WCET
+/** @brief Pior tempo de execuçao de cada transiçao (estado, evento, caminho) (fsm_wcet.c) */
+void fsm_wcet_run(void);
+#endif
+
+/** @brief Inicializa a maquina (paineis, catalogo, lugares, troco, botoes) sem arrancar a
+ * thread vm_fsm; chamada por main() ou, com ZTEST, pela suite de testes (main.c)
+ * @return 0 ou o erro da inicializaçao do catalogo ou dos botoes */
+int vm_init(void);
+
+#ifdef CONFIG_VENDING_TEST_HOOKS
+/** @brief Painel 0 controlado pela analise de WCET e pelos testes (main.c), sem a thread
+ * vm_fsm a correr: coloca-o no estado s com o credito, a sessao e a flag same_movie indicados */
+void vm_test_prepare(States s, int credit, uint16_t movie_idx, uint8_t same_movie);
+
+/** @brief Despacha um evento no painel 0 pelo motor de estados da build */
+void vm_test_dispatch(Event ev);
+
+/** @brief Coloca um evento na fila do painel 0, como a callback dos botoes
+ * @return false se a fila estiver cheia */
+bool vm_test_push(Event ev);
+
+/** @brief Despacha na thread atual todos os eventos em fila, pelo escalonador dos paineis
+ * @return numero de eventos despachados */
+int vm_test_run(void);
+
+/** @brief Estado atual do painel 0 */
+States vm_test_state(void);
+
+/** @brief Credito atual do painel 0 */
+int vm_test_credit(void);
+
+/** @brief Sessao apresentada no painel 0 */
+uint16_t vm_test_movie(void);
+
+/** @brief Credito de outro painel (troco reservado com CONFIG_VENDING_LANES > 1) */
+void vm_test_lane_credit(uint8_t lane, int credit);
+#endif
+
+#endif /* VENDING_H_ */
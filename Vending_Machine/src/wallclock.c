@@ -0,0 +1,73 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file wallclock.c
+* \brief Hora do dia a partir do tempo do kernel (ver wallclock.h)
+*/
+
+#include <zephyr.h>
+
+#include "wallclock.h"
+#include "recorder.h"
+
+#define MS_PER_MIN	(60 * 1000)
+#define MS_PER_HOUR	(60 * MS_PER_MIN)
+#define MS_PER_DAY	((int64_t)WALLCLOCK_DAY_MIN * MS_PER_MIN)
+
+static struct k_spinlock clock_lock;
+/** @brief Hora do dia (ms desde a meia-noite) no instante base_uptime */
+static int64_t base_ms;
+static int64_t base_uptime;
+
+static struct event_ring *clock_ring;
+static struct k_sem *clock_wake;
+
+static void hour_expired(struct k_timer *timer)
+{
+	event_ring_push(clock_ring, NONE);
+	k_sem_give(clock_wake);
+}
+
+K_TIMER_DEFINE(hour_timer, hour_expired, NULL);
+
+/** @brief ms desde a meia-noite */
+static int64_t wallclock_ms(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&clock_lock);
+	int64_t ms = base_ms + (k_uptime_get() - base_uptime);
+
+	k_spin_unlock(&clock_lock, key);
+	return ms % MS_PER_DAY;
+}
+
+void wallclock_set(uint16_t minute_of_day)
+{
+	k_spinlock_key_t key = k_spin_lock(&clock_lock);
+	int64_t ms;
+
+	base_ms = (int64_t)(minute_of_day % WALLCLOCK_DAY_MIN) * MS_PER_MIN;
+	base_uptime = k_uptime_get();
+	k_spin_unlock(&clock_lock, key);
+	recorder_clock(minute_of_day);
+
+	/* Proximo inicio de hora e depois de hora a hora */
+	ms = wallclock_ms();
+	k_timer_start(&hour_timer, K_MSEC(MS_PER_HOUR - ms % MS_PER_HOUR), K_MSEC(MS_PER_HOUR));
+	/* Acordar ja a maquina de estados para atualizar a vista com a hora nova */
+	if (clock_ring != NULL) {
+		hour_expired(&hour_timer);
+	}
+}
+
+uint16_t wallclock_minute(void)
+{
+	return (uint16_t)(wallclock_ms() / MS_PER_MIN);
+}
+
+void wallclock_init(struct event_ring *ring, struct k_sem *wake)
+{
+	clock_ring = ring;
+	clock_wake = wake;
+	wallclock_set(CONFIG_VENDING_WALLCLOCK_START);
+}
@@ -0,0 +1,49 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file wallclock.h
+* \brief Hora do dia para filtrar as sessoes que ja começaram
+*
+* A hora é mantida a partir do tempo do kernel (no nRF52840 contado pelo RTC1, que continua
+* a contar com o CPU em idle) e de um acerto: CONFIG_VENDING_WALLCLOCK_START no arranque ou
+* uma linha "TIME hh:mm" recebida pelo carregador do catalogo. No inicio de cada hora um
+* timer acorda a maquina de estados para retirar da vista as sessoes que começaram.
+*/
+
+#ifndef WALLCLOCK_H_
+#define WALLCLOCK_H_
+
+#include <zephyr.h>
+
+#include "event_ring.h"
+
+/** @brief Minutos num dia */
+#define WALLCLOCK_DAY_MIN (24 * 60)
+
+#ifdef CONFIG_VENDING_WALLCLOCK
+
+/** @brief Acerta a hora inicial e arma o timer do inicio de cada hora
+ * o timer coloca um evento NONE na fila e da o semaforo */
+void wallclock_init(struct event_ring *ring, struct k_sem *wake);
+
+/** @brief Acerta a hora (minutos desde a meia-noite) */
+void wallclock_set(uint16_t minute_of_day);
+
+/** @brief Minutos desde a meia-noite */
+uint16_t wallclock_minute(void);
+
+#else
+
+static inline void wallclock_init(struct event_ring *ring, struct k_sem *wake) { }
+static inline uint16_t wallclock_minute(void) { return 0; }
+
+#endif /* CONFIG_VENDING_WALLCLOCK */
+
+/** @brief Hora atual (0..23) */
+static inline uint8_t wallclock_hour(void)
+{
+	return wallclock_minute() / 60U;
+}
+
+#endif /* WALLCLOCK_H_ */
@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/* Baseline de native_posix (table): memoria do catalogo compilado (5 sessoes de 44 bytes)
+ * e de um indice com CONFIG_VENDING_CATALOG_MAX_SESSIONS=256. Os tempos dao 0 em
+ * native_posix (relogio simulado parado durante o despacho) e nao sao comparados */
+
+#define PERF_BASE_RAM_SEATS 220
+#define PERF_BASE_RAM_INDEX 1024
@@ -0,0 +1,448 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** \file main.c
+* \brief Testes funcionais e de desempenho da maquina de estados (ztest)
+*
+* A maquina é inicializada por vm_init() e a thread vm_fsm nao arranca: a thread de teste
+* coloca os eventos na fila do painel 0 e despacha-os pelo escalonador (vm_test_run()),
+* pelo mesmo caminho que a thread vm_fsm usa com os botoes. Cada caso de desempenho corre
+* CONFIG_VENDING_PERF_RUNS vezes a partir do mesmo estado e a mediana (ciclos de
+* k_cycle_get_32) é comparada com a baseline da placa e do motor de estados; o caso falha
+* se ficar mais de CONFIG_VENDING_PERF_TOLERANCE_PCT % acima. A memoria é comparada da
+* mesma forma. Cada valor é impresso numa linha "PERF" (ver scripts/perf_baseline.py).
+*
+* Em native_posix o relogio simulado nao avança durante o despacho: os tempos dao 0 e so
+* as verificaçoes funcionais e a memoria da aplicaçao contam.
+*/
+
+#include <string.h>
+#include <zephyr.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <ztest.h>
+#ifndef CONFIG_ARCH_POSIX
+#include <zephyr/linker/linker-defs.h>
+#endif
+
+#include "vending.h"
+#include "catalog.h"
+#include "seats.h"
+#include "change.h"
+#include "output.h"
+#include "wallclock.h"
+#include "catalog_loader.h"
+#include "catalog_delta.h"
+
+#ifdef PERF_BASELINE_H
+#include PERF_BASELINE_H
+#endif
+
+/* Sem baseline (0): falha nas placas que medem tempo, exceto ao gravar as baselines */
+#ifndef PERF_BASE_COIN_BURST
+#define PERF_BASE_COIN_BURST 0
+#endif
+#ifndef PERF_BASE_SCROLL
+#define PERF_BASE_SCROLL 0
+#endif
+#ifndef PERF_BASE_PURCHASE
+#define PERF_BASE_PURCHASE 0
+#endif
+#ifndef PERF_BASE_RAM_SEATS
+#define PERF_BASE_RAM_SEATS 0
+#endif
+#ifndef PERF_BASE_RAM_INDEX
+#define PERF_BASE_RAM_INDEX 0
+#endif
+#ifndef PERF_BASE_RAM_IMAGE
+#define PERF_BASE_RAM_IMAGE 0
+#endif
+#ifndef PERF_BASE_STACK
+#define PERF_BASE_STACK 0
+#endif
+
+/** @brief Placa que mede tempo: em native_posix o relogio simulado para durante o despacho */
+#define PERF_TIMED !IS_ENABLED(CONFIG_ARCH_POSIX)
+
+#define PERF_RUNS CONFIG_VENDING_PERF_RUNS
+#define PERF_TOLERANCE CONFIG_VENDING_PERF_TOLERANCE_PCT
+/** @brief Espera maxima pelo envio da saida da execuçao anterior (ms) */
+#define PERF_FLUSH_MS 200
+
+/** @brief Rajada de moedas: a ultima ultrapassa CHANGE_MAX com o troco de fabrica e é devolvida */
+static const Event coin_burst[] = {
+	ADD1, ADD2, ADD5, ADD10, ADD1, ADD2, ADD5, ADD10, ADD1, ADD2, ADD5, ADD10,
+};
+
+/** @brief Scroll: volta à sessao de partida */
+static const Event scroll[] = {
+	UP, UP, UP, UP, UP, UP, DOWN, DOWN, DOWN, DOWN, DOWN, DOWN,
+};
+
+static const uint8_t coin_value[NUM_EVENTS] = { [ADD1] = 1, [ADD2] = 2, [ADD5] = 5, [ADD10] = 10 };
+
+static uint32_t samples[PERF_RUNS];
+/** @brief Primeira sessao que ainda se pode comprar */
+static uint16_t idx_open;
+
+/** @brief Ordena as amostras (insertion sort, como em fsm_wcet.c) */
+static void perf_sort(uint32_t *v, int n)
+{
+	uint32_t x;
+	int i, j;
+
+	for (i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = x;
+	}
+}
+
+/** @brief Imprime um valor e compara-o com a baseline
+ * Sem baseline (0) o caso falha nas placas que medem tempo, para que um caminho novo ou uma
+ * baseline apagada nao passem sem comparaçao; com CONFIG_VENDING_PERF_RECORD so é impresso */
+static void perf_check(const char *name, const char *unit, uint32_t value, uint32_t base)
+{
+	uint32_t limit = base + (uint32_t)((uint64_t)base * PERF_TOLERANCE / 100U);
+	bool required = PERF_TIMED && !IS_ENABLED(CONFIG_VENDING_PERF_RECORD);
+
+	printk("PERF %s %u %s base %u limite %u %s\n", name, value, unit, base, limit,
+	       base == 0 ? "SEM_BASE" : (value <= limit ? "PASS" : "FAIL"));
+	if (base != 0) {
+		zassert_true(value <= limit, "%s: %u %s, mais de %d%% acima da baseline %u", name,
+			     value, unit, PERF_TOLERANCE, base);
+	} else {
+		zassert_false(required, "%s: sem baseline para %s (ver scripts/perf_baseline.py)", name,
+			      CONFIG_BOARD);
+	}
+}
+
+/** @brief Estado de partida de cada execuçao: troco de fabrica, salas vazias e painel 0 em s */
+static void perf_prepare(States s, int credit, uint8_t same_movie)
+{
+	output_flush(PERF_FLUSH_MS);
+	change_init();
+	seats_init(catalog_get());
+	vm_test_prepare(s, credit, idx_open, same_movie);
+}
+
+/** @brief Coloca os eventos na fila e despacha-os
+ * @param cycles ciclos desde o primeiro evento em fila ate ao fim do ultimo despacho */
+static void perf_run(const Event *ev, size_t n, uint32_t *cycles)
+{
+	uint32_t t0;
+	size_t i;
+	int done;
+
+	t0 = k_cycle_get_32();
+	for (i = 0; i < n; i++) {
+		zassert_true(vm_test_push(ev[i]), "fila do painel 0 cheia no evento %u", (uint32_t)i);
+	}
+	done = vm_test_run();
+	*cycles = k_cycle_get_32() - t0;
+	/* O timer da hora pode ter acrescentado um NONE */
+	zassert_true(done >= n, "%d de %u eventos despachados", done, (uint32_t)n);
+}
+
+static void test_coin_burst(void)
+{
+	int expected = 0;
+	size_t i;
+	int r;
+
+	for (i = 0; i < ARRAY_SIZE(coin_burst); i++) {
+		if (expected + coin_value[coin_burst[i]] <= CHANGE_MAX) {
+			expected += coin_value[coin_burst[i]];
+		}
+	}
+
+	for (r = 0; r < PERF_RUNS; r++) {
+		perf_prepare(MENU, 0, 1);
+		perf_run(coin_burst, ARRAY_SIZE(coin_burst), &samples[r]);
+		samples[r] /= ARRAY_SIZE(coin_burst);
+		zassert_equal(vm_test_credit(), expected, "credito %d, esperado %d", vm_test_credit(),
+			      expected);
+		zassert_equal(vm_test_state(), UPDATE_CREDIT, "estado %d depois das moedas",
+			      vm_test_state());
+	}
+	perf_sort(samples, PERF_RUNS);
+	perf_check("coin_burst", "ciclos/moeda", samples[PERF_RUNS / 2], PERF_BASE_COIN_BURST);
+}
+
+static void test_scroll(void)
+{
+	int r;
+
+	for (r = 0; r < PERF_RUNS; r++) {
+		perf_prepare(MOVIES, 0, 0);
+		perf_run(scroll, ARRAY_SIZE(scroll), &samples[r]);
+		samples[r] /= ARRAY_SIZE(scroll);
+		zassert_equal(vm_test_state(), MOVIES, "estado %d depois do scroll", vm_test_state());
+		zassert_equal(vm_test_movie(), idx_open, "sessao %u depois do scroll, esperada %u",
+			      vm_test_movie(), idx_open);
+	}
+	perf_sort(samples, PERF_RUNS);
+	perf_check("scroll", "ciclos/evento", samples[PERF_RUNS / 2], PERF_BASE_SCROLL);
+}
+
+static void test_purchase(void)
+{
+	const Event sel = SEL;
+	uint8_t price = catalog_price(catalog_get(), idx_open);
+	uint16_t free_seats;
+	int r;
+
+	for (r = 0; r < PERF_RUNS; r++) {
+		/* Credito exato: a compra nao depende do troco */
+		perf_prepare(MOVIES, price, 0);
+		free_seats = seats_free(idx_open);
+		perf_run(&sel, 1, &samples[r]);
+		zassert_equal(vm_test_state(), MENU, "estado %d depois da compra", vm_test_state());
+		zassert_equal(vm_test_credit(), 0, "credito %d depois da compra", vm_test_credit());
+		zassert_equal(seats_free(idx_open), free_seats - 1, "lugar nao foi ocupado");
+	}
+	perf_sort(samples, PERF_RUNS);
+	perf_check("purchase", "ciclos", samples[PERF_RUNS / 2], PERF_BASE_PURCHASE);
+}
+
+static void test_footprint(void)
+{
+#ifndef CONFIG_ARCH_POSIX
+	size_t unused;
+#endif
+
+	perf_check("ram_seats", "bytes", seats_mem_size(), PERF_BASE_RAM_SEATS);
+	perf_check("ram_index", "bytes", catalog_index_size(), PERF_BASE_RAM_INDEX);
+#ifndef CONFIG_ARCH_POSIX
+	perf_check("ram_image", "bytes", (uint32_t)(_image_ram_end - _image_ram_start),
+		   PERF_BASE_RAM_IMAGE);
+	/* A thread de teste fez o papel da thread vm_fsm nos casos anteriores */
+	zassert_equal(k_thread_stack_space_get(k_current_get(), &unused), 0,
+		      "pilha da thread de teste ilegivel");
+	perf_check("stack", "bytes", k_current_get()->stack_info.size - unused, PERF_BASE_STACK);
+#endif
+}
+
+/** @brief Dois paineis: o troco de uma compra no painel 0 nao pode gastar as moedas de que
+ * o painel 1 precisa para devolver o seu credito */
+static void test_change_reserved(void)
+{
+#if CONFIG_VENDING_LANES > 1
+	const Event sel = SEL;
+	uint8_t price = catalog_price(catalog_get(), idx_open);
+	struct change_stats st;
+	uint16_t stock[CHANGE_NUM_COINS];
+	uint8_t out[CHANGE_NUM_COINS];
+	uint16_t free_seats;
+	uint32_t cycles;
+	int i;
+
+	/* Stock com uma unica moeda de 2 EUR: paga o troco do painel 0 ou o credito do painel 1 */
+	perf_prepare(MOVIES, price + 2, 0);
+	change_stats_get(&st, stock);
+	for (i = 0; i < CHANGE_NUM_COINS; i++) {
+		for (; stock[i] > 0; stock[i]--) {
+			change_payout(change_coin_value[i], out);
+		}
+	}
+	change_deposit(2);
+	vm_test_lane_credit(1, 2);
+	free_seats = seats_free(idx_open);
+
+	perf_run(&sel, 1, &cycles);
+	zassert_equal(vm_test_state(), MOVIES, "estado %d: venda sem troco reservado",
+		      vm_test_state());
+	zassert_equal(vm_test_credit(), price + 2, "credito %d depois da recusa", vm_test_credit());
+	zassert_equal(seats_free(idx_open), free_seats, "lugar ocupado sem bilhete");
+	zassert_true(change_can_pay(2), "moeda do painel 1 gasta");
+
+	/* Sem credito no painel 1 a mesma compra é feita */
+	vm_test_lane_credit(1, 0);
+	perf_run(&sel, 1, &cycles);
+	zassert_equal(vm_test_state(), MENU, "estado %d depois da compra", vm_test_state());
+	zassert_equal(seats_free(idx_open), free_seats - 1, "lugar nao foi ocupado");
+#else
+	ztest_test_skip();
+#endif
+}
+
+/** @brief Troca de catalogo: os lugares vendidos acompanham o filme e a hora da sessao */
+static void test_seats_remap(void)
+{
+	static const str_handle_t t_old[] = { 0, 0, 1, 1 };
+	static const uint8_t h_old[] = { 19, 21, 19, 21 };
+	static const uint8_t p_old[] = { 9, 9, 9, 9 };
+	/* Sessoes reordenadas, uma nova (1, 20) e a sessao (1, 19) movida para outra hora */
+	static const str_handle_t t_new[] = { 1, 1, 0, 0 };
+	static const uint8_t h_new[] = { 21, 20, 21, 19 };
+	static const uint8_t p_new[] = { 9, 9, 9, 9 };
+	static const uint8_t sold_old[] = { 1, 2, 3, 4 };
+	static const uint8_t sold_new[] = { 4, 0, 2, 1 };
+	const struct catalog c_old = { ARRAY_SIZE(t_old), t_old, h_old, p_old };
+	const struct catalog c_new = { ARRAY_SIZE(t_new), t_new, h_new, p_new };
+	uint16_t i;
+	int n;
+
+	zassert_equal(seats_init(&c_old), 0, "seats_init falhou");
+	for (i = 0; i < ARRAY_SIZE(sold_old); i++) {
+		for (n = 0; n < sold_old[i]; n++) {
+			zassert_true(seats_take(i) >= 0, "sessao %u esgotada", i);
+		}
+	}
+	zassert_equal(seats_remap(&c_new), 0, "seats_remap falhou");
+	for (i = 0; i < ARRAY_SIZE(sold_new); i++) {
+		zassert_equal(SEATS_PER_SESSION - seats_free(i), sold_new[i],
+			      "sessao %u com %u lugares vendidos, esperados %u", i,
+			      SEATS_PER_SESSION - seats_free(i), sold_new[i]);
+	}
+	seats_init(catalog_get());
+}
+
+/** @brief Compra de grupo: sequencias no fim de uma fila, que nao passam para a fila
+ * seguinte, uma fila inteira e anulaçoes que repoem os lugares e as filas livres (a fila
+ * livre mais baixa é a que seats_take() usa) */
+static void test_seats_adjacent(void)
+{
+#if SEAT_ROWS >= 2 && SEATS_PER_ROW >= 5
+	const uint16_t s = 0;
+	int seat;
+
+	/* Sequencia que acaba exatamente no ultimo lugar da fila A */
+	seats_init(catalog_get());
+	zassert_equal(seats_take_adjacent(s, SEATS_PER_ROW - 3), 0, "inicio da fila A");
+	zassert_equal(seats_take_adjacent(s, 3), SEATS_PER_ROW - 3, "fim da fila A");
+	zassert_equal(seats_free(s), SEATS_PER_SESSION - SEATS_PER_ROW, "lugares livres");
+	/* Fila A cheia: deixou de estar nas filas livres */
+	zassert_equal(seats_take(s), SEATS_PER_ROW, "fila A ainda marcada como livre");
+	seats_release(s, SEATS_PER_ROW, 1);
+
+	/* Sobram 2 lugares no fim da fila A: 4 lugares seguidos so cabem na fila B */
+	seats_init(catalog_get());
+	zassert_equal(seats_take_adjacent(s, SEATS_PER_ROW - 2), 0, "inicio da fila A");
+	seat = seats_take_adjacent(s, 4);
+	zassert_equal(seat, SEATS_PER_ROW, "sequencia no lugar %d, esperado o inicio da fila B",
+		      seat);
+	zassert_equal(seats_free(s), SEATS_PER_SESSION - SEATS_PER_ROW - 2, "lugares livres");
+	/* Os 2 lugares da fila A continuam livres */
+	zassert_equal(seats_take(s), SEATS_PER_ROW - 2, "fim da fila A");
+
+	/* Fila inteira */
+	seats_init(catalog_get());
+	zassert_equal(seats_take_adjacent(s, SEATS_PER_ROW), 0, "fila A inteira");
+	zassert_equal(seats_take_adjacent(s, SEATS_PER_ROW), SEATS_PER_ROW, "fila B inteira");
+	zassert_equal(seats_free(s), SEATS_PER_SESSION - 2 * SEATS_PER_ROW, "lugares livres");
+	zassert_equal(seats_take_adjacent(s, SEATS_PER_ROW + 1), -EINVAL, "maior que uma fila");
+
+	/* Anular as filas A e B repoe os lugares e as filas livres */
+	seats_release(s, SEATS_PER_ROW, SEATS_PER_ROW);
+	seats_release(s, 0, SEATS_PER_ROW);
+	zassert_equal(seats_free(s), SEATS_PER_SESSION, "lugares livres depois da anulaçao");
+	zassert_equal(seats_take_adjacent(s, SEATS_PER_ROW), 0, "fila A nao voltou a estar livre");
+	seats_release(s, 0, SEATS_PER_ROW);
+
+	/* Anulaçao parcial a meio da fila: a mesma sequencia volta a ser vendida */
+	seat = seats_take_adjacent(s, 3);
+	zassert_equal(seats_take_adjacent(s, 2), 3, "sequencia a seguir");
+	seats_release(s, seat, 3);
+	zassert_equal(seats_free(s), SEATS_PER_SESSION - 2, "lugares livres depois da anulaçao");
+	zassert_equal(seats_take_adjacent(s, 3), seat, "sequencia anulada nao foi reposta");
+	seats_init(catalog_get());
+#else
+	ztest_test_skip();
+#endif
+}
+
+/** @brief Atualizaçao incremental a meio de um CAT de texto: é rejeitada com -EBUSY sem
+ * estragar a versao em carregamento, e o CAT termina e é publicado (ultimo caso: troca o
+ * catalogo usado pelos outros) */
+static void test_catalog_delta_during_text(void)
+{
+#ifdef CONFIG_VENDING_CATALOG_DELTA
+	static const char head[] = "CAT 2\n19 5 Filme A\n";
+	static const char tail[] = "20 6 Filme B\nEND\n";
+	struct catalog_swap_stats sw;
+	struct catalog_delta_stats before, after;
+	uint8_t delta[1 + 14 + 1];
+	const struct catalog *cat;
+	bool synced = false;
+	int i;
+
+	catalog_swap_stats_get(&sw);
+	catalog_delta_stats_get(&before);
+
+	/* Delta valido contra a versao publicada: SKIP de todas as sessoes */
+	delta[0] = CATALOG_DELTA_MAGIC;
+	sys_put_le32(sw.version, &delta[1]);
+	sys_put_le32(sw.version + 10, &delta[5]);
+	sys_put_le16(catalog_count(catalog_get()), &delta[9]);
+	sys_put_le16(catalog_crc(catalog_get()), &delta[11]);
+	sys_put_le16(1, &delta[13]);
+	delta[15] = catalog_count(catalog_get()) - 1;
+
+	catalog_loader_feed((const uint8_t *)head, strlen(head));
+	catalog_loader_feed(delta, sizeof(delta));
+	catalog_loader_feed((const uint8_t *)tail, strlen(tail));
+
+	/* A thread de teste faz o papel da vm_fsm: adotar a versao publicada pelo carregador */
+	for (i = 0; i < 100 && !synced; i++) {
+		k_sleep(K_MSEC(10));
+		synced = catalog_sync();
+	}
+	zassert_true(synced, "CAT de texto nao foi publicado");
+	catalog_delta_stats_get(&after);
+	zassert_equal(after.rejected, before.rejected + 1, "delta nao foi rejeitado");
+	zassert_equal(after.applied, before.applied, "delta aplicado a meio do CAT");
+
+	cat = catalog_get();
+	zassert_equal(catalog_count(cat), 2, "%u sessoes, esperadas 2", catalog_count(cat));
+	zassert_equal(strcmp(catalog_title_str(cat, 0), "Filme A"), 0, "sessao 0: %s",
+		      catalog_title_str(cat, 0));
+	zassert_equal(strcmp(catalog_title_str(cat, 1), "Filme B"), 0, "sessao 1: %s",
+		      catalog_title_str(cat, 1));
+	zassert_equal(catalog_hour(cat, 1), 20, "hora da sessao 1: %u", catalog_hour(cat, 1));
+#else
+	ztest_test_skip();
+#endif
+}
+
+/** @brief Inicializa a maquina e escolhe a sessao usada pelos outros casos */
+static void test_init(void)
+{
+	const struct catalog *cat;
+	uint16_t i;
+
+	zassert_equal(vm_init(), 0, "inicializaçao da maquina falhou");
+	/* Como a thread vm_fsm antes do primeiro evento: sessoes por começar a esta hora */
+	catalog_upcoming_update(wallclock_hour());
+
+	cat = catalog_get();
+	idx_open = UINT16_MAX;
+	for (i = 0; i < catalog_count(cat) && idx_open == UINT16_MAX; i++) {
+		if (catalog_bookable(i)) {
+			idx_open = i;
+		}
+	}
+	zassert_not_equal(idx_open, UINT16_MAX, "nenhuma sessao por começar no catalogo");
+
+	printk("PERF BEGIN %s %s\n", CONFIG_BOARD,
+	       IS_ENABLED(CONFIG_VENDING_FSM_SMF) ? "smf" : "table");
+}
+
+void test_main(void)
+{
+	/* Os casos correm por esta ordem e partilham a maquina inicializada por test_init */
+	ztest_test_suite(vending,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test(test_coin_burst),
+			 ztest_unit_test(test_scroll),
+			 ztest_unit_test(test_purchase),
+			 ztest_unit_test(test_footprint),
+			 ztest_unit_test(test_change_reserved),
+			 ztest_unit_test(test_seats_remap),
+			 ztest_unit_test(test_seats_adjacent),
+			 ztest_unit_test(test_catalog_delta_during_text));
+	ztest_run_test_suite(vending);
+}